@@ -5,12 +5,19 @@
 #include "Asem-FuncEH.hpp"
 #include "Asem-Func.hpp"
 #include "StringUtil.hpp"
+#include "HexCodec.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #define UCHAR unsigned char
 
 namespace asem {
@@ -72,7 +79,7 @@ void ELFHolder::clear() {
 #define ST_RD_DATA      8
 #define ST_RD_RODATA    9
     
-void ELFHolder::loadFromFile(const char * path) {
+void ELFHolder::loadFromFileLegacy(const char * path) {
 
     clear();
 
@@ -166,6 +173,374 @@ void ELFHolder::loadFromFile(const char * path) {
 
     }
 
+    sortRelocations();
+
+}
+
+// Fast path: the whole file is mapped and scanned once with pointers - no
+// line copies, no streams, no temporary strings (only the symbol names that
+// end up in the symbol table). Produces exactly what loadFromFileLegacy does.
+
+namespace {
+
+    inline
+    bool IsBlank(char c) {
+
+        return (c == ' ' || c == '\t');
+
+    }
+
+    // Field separators inside a line (as skipped by operator>> of a stream):
+    inline
+    bool IsSpace(char c) {
+
+        return (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f');
+
+    }
+
+    inline
+    int HexDigit(char c) {
+
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+        return -1;
+
+    }
+
+    struct Field {
+
+        const char * ptr;
+        size_t len;
+
+        bool is(const char * str) const {
+
+            return (std::strlen(str) == len && std::memcmp(ptr, str, len) == 0);
+
+        }
+
+    };
+
+    // Next whitespace-separated field of [ptr, end) (len = 0 at the end):
+    inline
+    Field NextField(const char *& ptr, const char * end) {
+
+        while (ptr < end && IsSpace(*ptr)) ptr += 1;
+
+        Field rv{ptr, 0};
+
+        while (ptr < end && !IsSpace(*ptr)) ptr += 1;
+
+        rv.len = size_t(ptr - rv.ptr);
+
+        return rv;
+
+    }
+
+    // As gen::string_is_integer (sign, then decimal or 0x-prefixed hex):
+    bool FieldIsInteger(Field f) {
+
+        if (f.len == 0) return false;
+        if (f.len == 1) return gen::char_is_digit(f.ptr[0]);
+
+        bool hex = false;
+
+        if (f.ptr[0] == '-' || f.ptr[0] == '+') {
+            f.ptr += 1;
+            f.len -= 1;
+        }
+
+        if (f.len > 2 && f.ptr[0] == '0' && (f.ptr[1] == 'x' || f.ptr[1] == 'X')) {
+            f.ptr += 2;
+            f.len -= 2;
+            hex = true;
+        }
+
+        for (size_t i = 0; i < f.len; i += 1) {
+
+            if (gen::char_is_digit(f.ptr[i]) || (hex && HexDigit(f.ptr[i]) >= 0))
+                continue;
+
+            return false;
+
+        }
+
+        return true;
+
+    }
+
+    // As std::stoi (decimal, stops at the first non-digit):
+    int FieldToDec(Field f) {
+
+        size_t i   = 0;
+        bool   neg = false;
+
+        if (i < f.len && (f.ptr[i] == '-' || f.ptr[i] == '+')) {
+            neg = (f.ptr[i] == '-');
+            i += 1;
+        }
+
+        int rv = 0;
+
+        for (; i < f.len && gen::char_is_digit(f.ptr[i]); i += 1)
+            rv = rv * 10 + (f.ptr[i] - '0');
+
+        return neg ? -rv : rv;
+
+    }
+
+    // As operator>> with std::hex (optional sign and 0x, 0 if not a number):
+    int FieldToHex(Field f) {
+
+        size_t i   = 0;
+        bool   neg = false;
+
+        if (i < f.len && (f.ptr[i] == '-' || f.ptr[i] == '+')) {
+            neg = (f.ptr[i] == '-');
+            i += 1;
+        }
+
+        if (i + 1 < f.len && f.ptr[i] == '0' && (f.ptr[i + 1] == 'x' || f.ptr[i + 1] == 'X'))
+            i += 2;
+
+        unsigned rv = 0;
+
+        for (int d; i < f.len && (d = HexDigit(f.ptr[i])) >= 0; i += 1)
+            rv = (rv << 4) | unsigned(d);
+
+        return neg ? -int(rv) : int(rv);
+
+    }
+
+    Section::Enum FieldToSection(Field f) {
+
+        if (f.is("Text"))   return Section::Text;
+        if (f.is("Data"))   return Section::Data;
+        if (f.is("BSS"))    return Section::BSS;
+        if (f.is("ROData")) return Section::ROData;
+
+        return Section::Undefined;
+
+    }
+
+    Scope::Enum FieldToScope(Field f) {
+
+        if (f.is("Local"))  return Scope::Local;
+        if (f.is("Global")) return Scope::Global;
+
+        return Scope::Undefined;
+
+    }
+
+    RelocType::Enum FieldToRelocType(Field f) {
+
+        if (f.is("R_ABS_08")) return RelocType::Abs_08;
+        if (f.is("R_ABS_16")) return RelocType::Abs_16;
+        if (f.is("R_ABS_32")) return RelocType::Abs_32;
+        if (f.is("R_PCR_16")) return RelocType::PCRel_16;
+
+        return RelocType::Undefined;
+
+    }
+
+    void ParseSymTab(ELFHolder & eh, const char * ptr, const char * end) {
+
+        Field ord  = NextField(ptr, end);
+        Field name = NextField(ptr, end);
+        Field val  = NextField(ptr, end);
+        Field sect = NextField(ptr, end);
+        Field scop = NextField(ptr, end);
+
+        int  value = 0;
+        bool def   = true;
+
+        if (FieldIsInteger(val)) {
+            value = FieldToDec(val);
+        } else {
+            if (val.is("?"))
+                def = false;
+            else
+                throw std::logic_error("asem::ElfHldProcSymTab(...) - Integer "
+                        "expected but [" + std::string(val.ptr, val.len) + "] provided.");
+        }
+
+        eh.symtab.data.emplace( name.ptr, name.len,
+            SymbolTableEntry( size_t(FieldToDec(ord)), FieldToScope(scop)
+                            , FieldToSection(sect), Section::Undefined, value, def ) );
+
+    }
+
+    void ParseRR(ELFHolder & eh, const char * ptr, const char * end, Section::Enum sec) {
+
+        Field off  = NextField(ptr, end);
+        Field type = NextField(ptr, end);
+        Field ord  = NextField(ptr, end);
+
+        eh.relocations[sec].emplace_back( FieldToRelocType(type)
+                                        , size_t(FieldToHex(off))
+                                        , size_t(FieldToHex(ord)) );
+
+    }
+
+    // "XX XX XX ..." - exactly two hex digits per byte, single spaces (the
+    // line is already cropped). Like gen::hex_to_buffer, a line replaces
+    // whatever the section held before.
+    void ParseSec(ELFHolder & eh, const char * ptr, const char * end, Section::Enum sec) {
+
+        std::vector<unsigned char> & buf = eh.sections[sec].data;
+
+        size_t len = size_t(end - ptr);
+
+        buf.resize(gen::hex_decoded_size(len));
+
+        if (!buf.empty() && gen::hex_decode(ptr, len, ' ', &buf[0])) return;
+
+        // Inner tabs separate bytes too (the legacy loader turns them into
+        // spaces):
+        std::string line{ptr, len};
+
+        std::replace(line.begin(), line.end(), '\t', ' ');
+
+        if (!buf.empty() && gen::hex_decode(line.data(), len, ' ', &buf[0])) return;
+
+        // (The slow path only to report the error exactly as before)
+        gen::hex_to_buffer(line, buf, ' ');
+
+    }
+
+}
+
+void ELFHolder::loadFromFile(const char * path) {
+
+    clear();
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        throw std::runtime_error(std::string{"Could not open file ["} + path + "] for reading.");
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error(std::string{"Could not read file ["} + path + "].");
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void * addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        throw std::runtime_error(std::string{"Could not map file ["} + path + "].");
+
+    try {
+
+        parse(static_cast<const char*>(addr), size_t(st.st_size));
+
+    } catch (...) {
+
+        munmap(addr, size_t(st.st_size));
+
+        throw;
+
+    }
+
+    munmap(addr, size_t(st.st_size));
+
+}
+
+void ELFHolder::parse(const char * text, size_t len) {
+
+    clear();
+
+    const char * end = text + len;
+
+    int state = ST_UNDEFINED;
+
+    while (text < end) {
+
+        // Line (cropped of blanks):
+        const char * nl = static_cast<const char*>(std::memchr(text, '\n', size_t(end - text)));
+
+        const char * head = text;
+        const char * tail = (nl != nullptr) ? nl : end;
+
+        text = (nl != nullptr) ? nl + 1 : end;
+
+        while (head < tail && IsBlank(*head))      head += 1;
+        while (tail > head && IsBlank(tail[-1]))   tail -= 1;
+
+        if (head == tail) continue;
+
+        // Process comment (does continue):
+        if (*head == '#') {
+
+            Field line{head, size_t(tail - head)};
+
+            if      (line.is("#.symtab"))     state = ST_RD_SYMTAB;
+            else if (line.is("#.ret.text"))   state = ST_RD_RR_TEXT;
+            else if (line.is("#.ret.bss"))    state = ST_RD_RR_BSS;
+            else if (line.is("#.ret.data"))   state = ST_RD_RR_DATA;
+            else if (line.is("#.ret.rodata")) state = ST_RD_RR_RODATA;
+            else if (line.is("#.text"))       state = ST_RD_TEXT;
+            else if (line.is("#.bss"))        state = ST_RD_BSS;
+            else if (line.is("#.data"))       state = ST_RD_DATA;
+            else if (line.is("#.rodata"))     state = ST_RD_RODATA;
+
+            // Otherwise it's a regular comment:
+            continue;
+
+        }
+
+        switch (state) {
+
+            // Symbol table:
+            case ST_RD_SYMTAB:
+                ParseSymTab(*this, head, tail);
+                break;
+
+            // Relocation records:
+            case ST_RD_RR_TEXT:   ParseRR(*this, head, tail, Section::Text  ); break;
+            case ST_RD_RR_BSS:    ParseRR(*this, head, tail, Section::BSS   ); break;
+            case ST_RD_RR_DATA:   ParseRR(*this, head, tail, Section::Data  ); break;
+            case ST_RD_RR_RODATA: ParseRR(*this, head, tail, Section::ROData); break;
+
+            // Sections:
+            case ST_RD_TEXT:   ParseSec(*this, head, tail, Section::Text  ); break;
+            case ST_RD_BSS:    ParseSec(*this, head, tail, Section::BSS   ); break;
+            case ST_RD_DATA:   ParseSec(*this, head, tail, Section::Data  ); break;
+            case ST_RD_RODATA: ParseSec(*this, head, tail, Section::ROData); break;
+
+        }
+
+    }
+
+    sortRelocations();
+
+}
+
+void ELFHolder::sortRelocations() {
+
+    for (size_t i = 0; i < 4; i += 1) {
+
+        std::vector<RelocRecord> & vec = relocations[i];
+
+        auto by_offset = [](const RelocRecord & a, const RelocRecord & b) {
+            return a.offset < b.offset;
+        };
+
+        // (Usually already sorted - the assembler emits them in order)
+        if (!std::is_sorted(vec.begin(), vec.end(), by_offset))
+            std::stable_sort(vec.begin(), vec.end(), by_offset);
+
+    }
+
 }
 
 #undef ST_UNDEFINED
@@ -235,10 +610,15 @@ std::string ELFHolder::secToString(Section::Enum sec) const {
         case Section::ROData: rv += ".rodata\n"; break;
     }
 
-    rv += gen::buffer_to_hex( &sections[sec].data[0] 
-                            ,  sections[sec].data.size() // sizeof(data[0]) = 1
-                            ,  ' '
-                            ) ;
+    size_t pos = rv.size();
+
+    rv.resize(pos + gen::hex_encoded_size(sections[sec].data.size()));
+
+    gen::hex_encode( &sections[sec].data[0]
+                   ,  sections[sec].data.size() // sizeof(data[0]) = 1
+                   ,  ' '
+                   ,  &rv[pos]
+                   ) ;
 
     return rv;
 
@@ -5,7 +5,6 @@
 #include "Asem-Enumeration.hpp"
 #include "Asem-SymTab.hpp"
 
-#include <list>
 #include <vector>
 #include <string>
 
@@ -31,6 +30,20 @@ namespace asem {
         
     };
     
+    // Bytes patched by a relocation (0 - unknown type, not applied):
+    inline
+    size_t RelocWidth(RelocType::Enum type) {
+        
+        switch (type) {
+            case RelocType::Abs_08:   return 1u;
+            case RelocType::Abs_16:   return 2u;
+            case RelocType::Abs_32:   return 4u;
+            case RelocType::PCRel_16: return 2u;
+            default:                  return 0u;
+        }
+        
+    }
+    
     ////////////////////////////////////////////////////////////////////////////
     
     struct BinaryVector {
@@ -51,7 +64,8 @@ namespace asem {
         
         SymbolTable symtab;
         
-        std::list<RelocRecord> relocations[4];
+        // Per section, sorted by offset (see sortRelocations):
+        std::vector<RelocRecord> relocations[4];
         
         BinaryVector sections[4];
         
@@ -61,7 +75,14 @@ namespace asem {
         
         void clear();
         
-        void loadFromFile(const char * path);
+        void loadFromFile(const char * path);       // Mapped, then parse()
+        void loadFromFileLegacy(const char * path); // Line by line (streams)
+        
+        // Single pass over the text of a whole .se file.
+        void parse(const char * text, size_t len);
+        
+        // Stable - records at the same offset keep their order.
+        void sortRelocations();
         
         std::string  rrToString(Section::Enum sec) const;
         std::string secToString(Section::Enum sec) const;
@@ -3,6 +3,7 @@
 #include "Asem-ELFHolder.hpp"
 #include "Asem-SymTab.hpp"
 #include "StringUtil.hpp"
+#include "HexCodec.hpp"
 
 #include <string>
 #include <sstream>
@@ -104,7 +105,13 @@ void ElfHldProcRR(ELFHolder & eh, const std::string & line, Section::Enum sec) {
 
 void ElfHldProcSec(ELFHolder & eh, const std::string & line, Section::Enum sec) {
 
-    gen::hex_to_buffer(line, eh.sections[sec].data, ' ');
+    std::vector<unsigned char> & buf = eh.sections[sec].data;
+
+    buf.resize(gen::hex_decoded_size(line.size()));
+
+    // (The slow path only to report the error exactly as before)
+    if (buf.empty() || !gen::hex_decode(line.data(), line.size(), ' ', &buf[0]))
+        gen::hex_to_buffer(line, buf, ' ');
 
 }
     
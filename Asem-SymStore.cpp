@@ -0,0 +1,173 @@
+
+#include "Asem-SymStore.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+namespace asem {
+
+const std::uint32_t SymbolStore::NO_NAME;
+
+SymbolStore::SymbolStore()
+    : count(0) {
+    
+    index.assign(16u, 0u);
+    
+}
+
+void SymbolStore::clear() {
+    
+    entries.clear();
+    name_off.clear();
+    name_len.clear();
+    hashes.clear();
+    arena.clear();
+    index.assign(16u, 0u);
+    count = 0;
+    
+}
+
+void SymbolStore::reserve(size_t symbol_cnt) {
+    
+    entries.reserve(symbol_cnt);
+    name_off.reserve(symbol_cnt);
+    name_len.reserve(symbol_cnt);
+    hashes.reserve(symbol_cnt);
+    arena.reserve(symbol_cnt * 12u);
+    
+    size_t slot_cnt = index.size();
+    
+    while (slot_cnt < symbol_cnt * 2u) slot_cnt *= 2u;
+    
+    if (slot_cnt != index.size()) rehash(slot_cnt);
+    
+}
+
+std::uint32_t SymbolStore::Hash(const char * name, size_t len) {
+    
+    // FNV-1a:
+    std::uint32_t h = 2166136261u;
+    
+    for (size_t i = 0; i < len; i += 1) {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 16777619u;
+    }
+    
+    return h;
+    
+}
+
+size_t SymbolStore::probe(const char * name, size_t len, std::uint32_t hash) const {
+    
+    size_t mask = index.size() - 1u; // (Power of two)
+    size_t slot = hash & mask;
+    
+    for (;;) {
+        
+        std::uint32_t ord1 = index[slot];
+        
+        if (ord1 == 0u) return slot;
+        
+        size_t ord = ord1 - 1u;
+        
+        if (hashes[ord] == hash && name_len[ord] == len &&
+            std::memcmp(&arena[name_off[ord]], name, len) == 0) return slot;
+            
+        slot = (slot + 1u) & mask;
+        
+    }
+    
+}
+
+void SymbolStore::rehash(size_t slot_cnt) {
+    
+    index.assign(slot_cnt, 0u);
+    
+    size_t mask = slot_cnt - 1u;
+    
+    for (size_t ord = 0; ord < entries.size(); ord += 1) {
+        
+        if (name_off[ord] == NO_NAME) continue;
+        
+        size_t slot = hashes[ord] & mask;
+        
+        while (index[slot] != 0u) slot = (slot + 1u) & mask;
+        
+        index[slot] = std::uint32_t(ord + 1u);
+        
+    }
+    
+}
+
+bool SymbolStore::emplace(const char * name, size_t len, const SymbolTableEntry & entry) {
+    
+    std::uint32_t hash = Hash(name, len);
+    
+    size_t slot = probe(name, len, hash);
+    
+    if (index[slot] != 0u) return false; // Already present
+    
+    size_t ord = entry.ordinal;
+    
+    if (ord >= NO_NAME)
+        throw std::logic_error("asem::SymbolStore::emplace(...) - Ordinal of symbol ["
+                               + std::string(name, len) + "] is out of range.");
+                               
+    if (ord < entries.size() && name_off[ord] != NO_NAME)
+        throw std::logic_error("asem::SymbolStore::emplace(...) - Symbols ["
+                               + std::string(this->name(ord)) + "] and ["
+                               + std::string(name, len) + "] have the same ordinal.");
+                               
+    if (ord >= entries.size()) {
+        entries .resize(ord + 1u);
+        name_off.resize(ord + 1u, NO_NAME);
+        name_len.resize(ord + 1u, 0u);
+        hashes  .resize(ord + 1u, 0u);
+    }
+    
+    entries [ord] = entry;
+    name_off[ord] = std::uint32_t(arena.size());
+    name_len[ord] = std::uint32_t(len);
+    hashes  [ord] = hash;
+    
+    arena.insert(arena.end(), name, name + len);
+    arena.push_back('\0');
+    
+    index[slot] = std::uint32_t(ord + 1u);
+    count += 1;
+    
+    // Keep the load factor at most 1/2:
+    if (count * 2u > index.size()) rehash(index.size() * 2u);
+    
+    return true;
+    
+}
+
+const SymbolTableEntry * SymbolStore::find(const char * name, size_t len) const {
+    
+    std::uint32_t ord1 = index[probe(name, len, Hash(name, len))];
+    
+    return (ord1 == 0u) ? nullptr : &entries[ord1 - 1u];
+    
+}
+
+const SymbolTableEntry * SymbolStore::find(const char * name) const {
+    
+    return find(name, std::strlen(name));
+    
+}
+
+const SymbolTableEntry & SymbolStore::at(const std::string & name) const {
+    
+    const SymbolTableEntry * entry = find(name);
+    
+    if (entry == nullptr)
+        throw std::out_of_range("asem::SymbolStore::at(...) - Symbol ["
+                                + name + "] not present.");
+                                
+    return *entry;
+    
+}
+
+}
+
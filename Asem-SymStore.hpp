@@ -0,0 +1,124 @@
+
+#ifndef ASEM_SYMSTORE_HPP
+#define ASEM_SYMSTORE_HPP
+
+#include "Asem-Enumeration.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace asem {
+    
+    struct SymbolTableEntry {
+        
+        //std::string name;
+        size_t ordinal;
+        Scope::Enum scope;
+        Section::Enum section;
+        Section::Enum relative_to;
+        int value;
+        bool defined;
+        
+        SymbolTableEntry
+            //( const std::string & name = "UND"
+            ( size_t ordinal = 0
+            , Scope::Enum scope = Scope::Undefined
+            , Section::Enum section = Section::Undefined
+            , Section::Enum relative_to = Section::Undefined
+            , int value = 0
+            , bool defined = false
+            )
+            //: name(name)
+            : ordinal(ordinal)
+            , scope(scope)
+            , section(section)
+            , relative_to(relative_to)
+            , value(value)
+            , defined(defined)
+            { }
+            
+    };
+    
+    // Symbols stored flat: entries in a vector indexed by ordinal, names
+    // interned in one character arena and an open-addressing hash index from
+    // name to ordinal. find(...) returns the entry itself (nullptr if the
+    // name is not present), so a lookup is one hash probe sequence.
+    //
+    // Ordinals need not be dense (gaps are skipped by has(...)), but each
+    // one may be used by a single name. Entry pointers and names stay valid
+    // until the next emplace(...) or clear().
+    class SymbolStore {
+    
+    public:
+        
+        SymbolStore();
+        
+        void clear();
+        
+        void reserve(size_t symbol_cnt);
+        
+        // Inserts the entry under its ordinal unless the name is already
+        // present (then nothing changes - like std::unordered_map::emplace).
+        // Returns true if inserted; throws std::logic_error if the ordinal
+        // belongs to another name.
+        bool emplace(const char * name, size_t len, const SymbolTableEntry & entry);
+        
+        bool emplace(const std::string & name, const SymbolTableEntry & entry) {
+            return emplace(name.data(), name.size(), entry);
+        }
+        
+        const SymbolTableEntry * find(const char * name, size_t len) const;
+        
+        const SymbolTableEntry * find(const char * name) const;
+        
+        const SymbolTableEntry * find(const std::string & name) const {
+            return find(name.data(), name.size());
+        }
+        
+        // Throws std::out_of_range if not present:
+        const SymbolTableEntry & at(const std::string & name) const;
+        
+        // Number of symbols:
+        size_t size() const { return count; }
+        
+        // One past the highest ordinal:
+        size_t ordinals() const { return entries.size(); }
+        
+        bool has(size_t ordinal) const {
+            return ordinal < entries.size() && name_off[ordinal] != NO_NAME;
+        }
+        
+        // (Only for ordinals with has(ordinal) == true)
+        const SymbolTableEntry & entry(size_t ordinal) const { return entries[ordinal]; }
+        
+        const char * name(size_t ordinal) const { return &arena[name_off[ordinal]]; }
+        
+        size_t nameLength(size_t ordinal) const { return name_len[ordinal]; }
+        
+    private:
+        
+        static const std::uint32_t NO_NAME = 0xFFFFFFFFu;
+        
+        std::vector<SymbolTableEntry> entries;  // By ordinal
+        std::vector<std::uint32_t>    name_off; // By ordinal (NO_NAME - gap)
+        std::vector<std::uint32_t>    name_len; // By ordinal
+        std::vector<std::uint32_t>    hashes;   // By ordinal
+        std::vector<char>             arena;    // NUL-terminated names
+        std::vector<std::uint32_t>    index;    // Ordinal + 1 (0 - empty slot)
+        size_t                        count;
+        
+        static std::uint32_t Hash(const char * name, size_t len);
+        
+        // Slot holding the name, or the empty slot ending its probe sequence:
+        size_t probe(const char * name, size_t len, std::uint32_t hash) const;
+        
+        void rehash(size_t slot_cnt);
+        
+    };
+    
+}
+
+#endif /* ASEM_SYMSTORE_HPP */
+
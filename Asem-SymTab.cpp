@@ -3,7 +3,6 @@
 #include "Asem-Func.hpp"
 
 #include <stdexcept>
-#include <unordered_map>
 
 #include "StringUtil.hpp"
 
@@ -27,11 +26,11 @@ void SymbolTable::reset() {
 
 int SymbolTable::check(const std::string & symbol_name) const {
     
-    auto iter = data.find(symbol_name);
+    const SymbolTableEntry * entry = data.find(symbol_name);
     
-    if (iter == data.end()) return NOT_PRESENT;
+    if (entry == nullptr) return NOT_PRESENT;
     
-    if ((*iter).second.defined == false) return UNDEFINED;
+    if (entry->defined == false) return UNDEFINED;
     
     return DEFINED;
     
@@ -39,15 +38,27 @@ int SymbolTable::check(const std::string & symbol_name) const {
 
 void SymbolTable::toOrderedVector(std::vector<std::pair<std::string,SymbolTableEntry>> & vec) const {
     
-    vec.resize(data.size());
+    vec.resize(data.ordinals());
     
-    for (auto pair : data) {
+    for (size_t i = 0; i < data.ordinals(); i += 1) {
         
-        size_t index = pair.second.ordinal;
+        if (!data.has(i)) continue;
         
-        vec[index].first = pair.first;
+        vec[i].first.assign(data.name(i), data.nameLength(i));
         
-        vec[index].second = pair.second;
+        vec[i].second = data.entry(i);
+        
+    }
+    
+}
+
+void SymbolTable::toValueVector(std::vector<int> & vec) const {
+    
+    vec.assign(data.ordinals(), 0);
+    
+    for (size_t i = 0; i < data.ordinals(); i += 1) {
+        
+        if (data.has(i)) vec[i] = data.entry(i).value;
         
     }
     
@@ -94,12 +105,14 @@ ExpressionValue SymbolTable::eval(size_t line_ord, const std::string & expr) con
                 if  (!(string_is_identifier(s) && !char_is_digit(s[0])))
                     throw std::logic_error("Cannot evaluate token [" + s + "] in expression (not an identifier).");
                 
-                if (check(s) != DEFINED)
+                const SymbolTableEntry * entry = data.find(s);
+                
+                if (entry == nullptr || !entry->defined)
                     throw std::logic_error("Cannot evaluate token [" + s + "] in expression (undefined).");
                   
-                i = data.at(s).value;
+                i = entry->value;
                 
-                offsets[ data.at(s).section ] += sign;
+                offsets[ entry->section ] += sign;
                 
             }
             
@@ -203,13 +216,17 @@ ExpressionValue SymbolTable::eval(size_t line_ord, const std::string & expr) con
 
 void SymbolTable::verify() const {
     
-    for (const std::pair<std::string, SymbolTableEntry> & pair : data) {
+    for (size_t i = 0; i < data.ordinals(); i += 1) {
+        
+        if (!data.has(i)) continue;
+        
+        const SymbolTableEntry & entry = data.entry(i);
         
-        if (pair.second.scope != Scope::Global && pair.second.defined == false) {
+        if (entry.scope != Scope::Global && entry.defined == false) {
             
-            if (pair.second.ordinal == 0) continue; // NULL Symbol
+            if (entry.ordinal == 0) continue; // NULL Symbol
             
-            throw std::logic_error("\b\b\b<unknown>: Symbol [" + pair.first + "] used but not defined or imported.");
+            throw std::logic_error("\b\b\b<unknown>: Symbol [" + std::string(data.name(i)) + "] used but not defined or imported.");
             
         }
         
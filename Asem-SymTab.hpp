@@ -3,8 +3,8 @@
 #define ASEM_SYMTAB_HPP
 
 #include "Asem-Enumeration.hpp"
+#include "Asem-SymStore.hpp"
 
-#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -28,43 +28,13 @@ namespace asem {
         
     };
     
-    struct SymbolTableEntry {
-        
-        //std::string name;
-        size_t ordinal;
-        Scope::Enum scope;
-        Section::Enum section;
-        Section::Enum relative_to;
-        int value;
-        bool defined;
-        
-        SymbolTableEntry
-            //( const std::string & name = "UND"
-            ( size_t ordinal = 0
-            , Scope::Enum scope = Scope::Undefined
-            , Section::Enum section = Section::Undefined
-            , Section::Enum relative_to = Section::Undefined
-            , int value = 0
-            , bool defined = false
-            )
-            //: name(name)
-            : ordinal(ordinal)
-            , scope(scope)
-            , section(section)
-            , relative_to(relative_to)
-            , value(value)
-            , defined(defined)
-            { }
-        
-    };
-    
     struct SymbolTable {
         
         static const int NOT_PRESENT = 0;
         static const int UNDEFINED   = 1;
         static const int DEFINED     = 2;
         
-        std::unordered_map<std::string, SymbolTableEntry> data;
+        SymbolStore data;
         size_t counter[4];
         Section::Enum curr_section;
         
@@ -74,8 +44,16 @@ namespace asem {
         
         int check(const std::string & symbol_name) const;
         
+        // Entry of a symbol (nullptr if not present):
+        const SymbolTableEntry * find(const std::string & symbol_name) const {
+            return data.find(symbol_name);
+        }
+        
         void toOrderedVector(std::vector<std::pair<std::string,SymbolTableEntry>> & vec) const;
         
+        // Values only, indexed by ordinal (no names copied):
+        void toValueVector(std::vector<int> & vec) const;
+        
         ExpressionValue eval(size_t line_ord, const std::string & expr) const;
         
         void verify() const;
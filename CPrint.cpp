@@ -3,19 +3,33 @@
 
 #include <iostream>
 #include <stdarg.h>
+#include <stdio.h>
 #include <ncurses.h>
 
+static bool cprint_to_stderr = false;
+
+void cprint_headless(bool headless) {
+    
+    cprint_to_stderr = headless;
+    
+}
+
 int cprint(const char * format, ...) {
     
-    static char buffer[1024];
+    char buffer[1024]; // (Not static - cprint may be called from any thread)
     
     va_list args;
     va_start(args, format);
     
-    vsnprintf(buffer, 1024u, format, args);
+    int rv = vsnprintf(buffer, 1024u, format, args);
     
     va_end(args);
     
+    if (cprint_to_stderr) {
+        fputs(buffer, stderr);
+        return rv;
+    }
+    
     for (size_t i = 0; i < 1024u; i += 1) {
         
         if (buffer[i] == '\0') break;
@@ -32,4 +46,6 @@ int cprint(const char * format, ...) {
     vprintf(format, args);
     va_end(args);*/
     
+    return rv;
+    
 }
\ No newline at end of file
@@ -6,5 +6,9 @@
 
 int cprint(const char * format, ...);
 
+// Headless mode: print to stderr instead of the ncurses screen (set once,
+// before any other thread is started).
+void cprint_headless(bool headless);
+
 #endif /* CPRINT_HPP */
 
@@ -0,0 +1,479 @@
+
+#include "HexCodec.hpp"
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HEX_X86 1
+#include <immintrin.h>
+#else
+#define HEX_X86 0
+#endif
+
+namespace gen {
+    
+    namespace {
+        
+        typedef bool (*DecodeFunc)(const char *, std::size_t, char, unsigned char *);
+        typedef void (*EncodeFunc)(const unsigned char *, std::size_t, char, char *);
+        
+        const char HEX_DIGITS[16] = { '0', '1', '2', '3', '4', '5', '6', '7'
+                                    , '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+                                    
+        // Character -> nibble (-1 for non-hex characters):
+        struct NibbleTable {
+            
+            signed char val[256];
+            
+            NibbleTable() {
+                
+                for (int i = 0; i < 256; i += 1) val[i] = -1;
+                
+                for (int i = 0; i < 10; i += 1) val['0' + i] = static_cast<signed char>(i);
+                
+                for (int i = 0; i < 6; i += 1) {
+                    val['a' + i] = static_cast<signed char>(10 + i);
+                    val['A' + i] = static_cast<signed char>(10 + i);
+                }
+                
+            }
+            
+        };
+        
+        const NibbleTable NIBBLES{};
+        
+        ////////////////////////////////////////////////////////////////////////
+        // Scalar (also finishes what the vector kernels leave over):
+        
+        // Decodes bytes [first, n) of the string (src and dst at byte 0).
+        bool DecodeScalar(const char * src, std::size_t n, std::size_t first,
+                          char separator, unsigned char * dst) {
+                          
+            for (std::size_t i = first; i < n; i += 1) {
+                
+                const char * p = src + i * 3u;
+                
+                int hi = NIBBLES.val[static_cast<unsigned char>(p[0])];
+                int lo = NIBBLES.val[static_cast<unsigned char>(p[1])];
+                
+                if ((hi | lo) < 0) return false;
+                
+                if (i + 1u < n && p[2] != separator) return false;
+                
+                dst[i] = static_cast<unsigned char>((hi << 4) | lo);
+                
+            }
+            
+            return true;
+            
+        }
+        
+        void EncodeScalar(const unsigned char * src, std::size_t n, std::size_t first,
+                          char separator, char * dst) {
+                          
+            for (std::size_t i = first; i < n; i += 1) {
+                
+                char * p = dst + i * 3u;
+                
+                p[0] = HEX_DIGITS[src[i] >> 4];
+                p[1] = HEX_DIGITS[src[i] & 0x0Fu];
+                
+                if (i + 1u < n) p[2] = separator;
+                
+            }
+            
+        }
+        
+        bool DecodeScalarAll(const char * src, std::size_t len, char separator, unsigned char * dst) {
+            
+            return DecodeScalar(src, hex_decoded_size(len), 0, separator, dst);
+            
+        }
+        
+        void EncodeScalarAll(const unsigned char * src, std::size_t n, char separator, char * dst) {
+            
+            EncodeScalar(src, n, 0, separator, dst);
+            
+        }
+
+#if HEX_X86
+
+        ////////////////////////////////////////////////////////////////////////
+        // Vector kernels. A block is 16 bytes <-> 48 characters ("XX " x 16),
+        // spread over three 16-character vectors; pshufb gathers the digits
+        // (decode) or scatters them between the separators (encode).
+        
+        struct ShuffleMasks {
+            
+            // Decode: [vector][output byte] -> character index in the vector
+            alignas(16) unsigned char dec_hi [3][16];
+            alignas(16) unsigned char dec_lo [3][16];
+            alignas(16) unsigned char dec_sep[3][16];
+            
+            // Encode: [output vector][character] -> byte index
+            alignas(16) unsigned char enc_hi [3][16];
+            alignas(16) unsigned char enc_lo [3][16];
+            alignas(16) unsigned char enc_sep[3][16]; // 0xFF at separators
+            
+            ShuffleMasks() {
+                
+                for (int k = 0; k < 3; k += 1) {
+                    
+                    for (int j = 0; j < 16; j += 1) {
+                        
+                        int hi = 3 * j, lo = hi + 1, sep = hi + 2;
+                        
+                        dec_hi [k][j] = (hi  / 16 == k) ? static_cast<unsigned char>(hi  % 16) : 0x80u;
+                        dec_lo [k][j] = (lo  / 16 == k) ? static_cast<unsigned char>(lo  % 16) : 0x80u;
+                        dec_sep[k][j] = (sep / 16 == k) ? static_cast<unsigned char>(sep % 16) : 0x80u;
+                        
+                        int c = 16 * k + j; // Character
+                        
+                        enc_hi [k][j] = (c % 3 == 0) ? static_cast<unsigned char>(c / 3) : 0x80u;
+                        enc_lo [k][j] = (c % 3 == 1) ? static_cast<unsigned char>(c / 3) : 0x80u;
+                        enc_sep[k][j] = (c % 3 == 2) ? 0xFFu : 0x00u;
+                        
+                    }
+                    
+                }
+                
+            }
+            
+        };
+        
+        const ShuffleMasks MASKS{};
+        
+        // ASCII hex digits -> nibbles; *bad gets the lanes that aren't digits.
+        __attribute__((target("ssse3")))
+        inline __m128i NibblesSSSE3(__m128i c, __m128i * bad) {
+            
+            __m128i low = _mm_or_si128(c, _mm_set1_epi8(0x20)); // (Letters only)
+            
+            __m128i dig = _mm_and_si128( _mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1))
+                                       , _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c) );
+            __m128i let = _mm_and_si128( _mm_cmpgt_epi8(low, _mm_set1_epi8('a' - 1))
+                                       , _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), low) );
+                                       
+            *bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(dig, let), _mm_set1_epi8(-1)));
+            
+            return _mm_or_si128( _mm_and_si128(dig, _mm_sub_epi8(c, _mm_set1_epi8('0')))
+                               , _mm_and_si128(let, _mm_sub_epi8(low, _mm_set1_epi8('a' - 10))) );
+                               
+        }
+        
+        __attribute__((target("ssse3")))
+        inline __m128i Gather3SSSE3(__m128i a, __m128i b, __m128i c, const unsigned char (*m)[16]) {
+            
+            return _mm_or_si128(
+                _mm_or_si128( _mm_shuffle_epi8(a, _mm_load_si128(reinterpret_cast<const __m128i*>(m[0])))
+                            , _mm_shuffle_epi8(b, _mm_load_si128(reinterpret_cast<const __m128i*>(m[1]))) ),
+                _mm_shuffle_epi8(c, _mm_load_si128(reinterpret_cast<const __m128i*>(m[2]))) );
+                
+        }
+        
+        __attribute__((target("ssse3")))
+        bool DecodeSSSE3(const char * src, std::size_t len, char separator, unsigned char * dst) {
+            
+            std::size_t n = hex_decoded_size(len);
+            std::size_t i = 0;
+            
+            __m128i bad = _mm_setzero_si128();
+            __m128i sep = _mm_set1_epi8(separator);
+            
+            // (Blocks end with a separator - the last byte is left to the tail)
+            for (; (i + 16u) * 3u <= len; i += 16u) {
+                
+                const char * p = src + i * 3u;
+                
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+                
+                __m128i hi = NibblesSSSE3(Gather3SSSE3(a, b, c, MASKS.dec_hi), &bad);
+                __m128i lo = NibblesSSSE3(Gather3SSSE3(a, b, c, MASKS.dec_lo), &bad);
+                
+                bad = _mm_or_si128(bad, _mm_andnot_si128( _mm_cmpeq_epi8(Gather3SSSE3(a, b, c, MASKS.dec_sep), sep)
+                                                        , _mm_set1_epi8(-1) ));
+                                                        
+                // (hi < 16, so the 16-bit shift doesn't cross bytes)
+                __m128i bytes = _mm_or_si128(_mm_slli_epi16(hi, 4), lo);
+                
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+                
+            }
+            
+            if (_mm_movemask_epi8(bad) != 0) return false;
+            
+            return DecodeScalar(src, n, i, separator, dst);
+            
+        }
+        
+        __attribute__((target("ssse3")))
+        inline __m128i DigitsSSSE3(__m128i nib) {
+            
+            __m128i adj = _mm_and_si128(_mm_cmpgt_epi8(nib, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+            
+            return _mm_add_epi8(_mm_add_epi8(nib, _mm_set1_epi8('0')), adj);
+            
+        }
+        
+        __attribute__((target("ssse3")))
+        void EncodeSSSE3(const unsigned char * src, std::size_t n, char separator, char * dst) {
+            
+            std::size_t i = 0;
+            
+            __m128i sep = _mm_set1_epi8(separator);
+            __m128i low = _mm_set1_epi8(0x0F);
+            
+            // (Blocks end with a separator - the last byte is left to the tail)
+            for (; i + 16u < n; i += 16u) {
+                
+                __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i hi = DigitsSSSE3(_mm_and_si128(_mm_srli_epi16(x, 4), low));
+                __m128i lo = DigitsSSSE3(_mm_and_si128(x, low));
+                
+                char * p = dst + i * 3u;
+                
+                for (int k = 0; k < 3; k += 1) {
+                    
+                    __m128i out = _mm_or_si128(
+                        _mm_or_si128( _mm_shuffle_epi8(hi, _mm_load_si128(reinterpret_cast<const __m128i*>(MASKS.enc_hi[k])))
+                                    , _mm_shuffle_epi8(lo, _mm_load_si128(reinterpret_cast<const __m128i*>(MASKS.enc_lo[k]))) ),
+                        _mm_and_si128(sep, _mm_load_si128(reinterpret_cast<const __m128i*>(MASKS.enc_sep[k]))) );
+                        
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16 * k), out);
+                    
+                }
+                
+            }
+            
+            EncodeScalar(src, n, i, separator, dst);
+            
+        }
+        
+        // AVX2: two blocks per step, one per 128-bit lane (pshufb works within
+        // lanes, so the masks are the SSSE3 ones in both lanes).
+        
+        __attribute__((target("avx2")))
+        inline __m256i Mask256(const unsigned char * m) {
+            
+            return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(m)));
+            
+        }
+        
+        __attribute__((target("avx2")))
+        inline __m256i Load2x128(const char * lo, const char * hi) {
+            
+            return _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)), 1);
+                
+        }
+        
+        __attribute__((target("avx2")))
+        inline __m256i NibblesAVX2(__m256i c, __m256i * bad) {
+            
+            __m256i low = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+            
+            __m256i dig = _mm256_and_si256( _mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1))
+                                          , _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c) );
+            __m256i let = _mm256_and_si256( _mm256_cmpgt_epi8(low, _mm256_set1_epi8('a' - 1))
+                                          , _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), low) );
+                                          
+            *bad = _mm256_or_si256(*bad, _mm256_andnot_si256(_mm256_or_si256(dig, let), _mm256_set1_epi8(-1)));
+            
+            return _mm256_or_si256( _mm256_and_si256(dig, _mm256_sub_epi8(c, _mm256_set1_epi8('0')))
+                                  , _mm256_and_si256(let, _mm256_sub_epi8(low, _mm256_set1_epi8('a' - 10))) );
+                                  
+        }
+        
+        __attribute__((target("avx2")))
+        inline __m256i Gather3AVX2(__m256i a, __m256i b, __m256i c, const unsigned char (*m)[16]) {
+            
+            return _mm256_or_si256(
+                _mm256_or_si256( _mm256_shuffle_epi8(a, Mask256(m[0]))
+                               , _mm256_shuffle_epi8(b, Mask256(m[1])) ),
+                _mm256_shuffle_epi8(c, Mask256(m[2])) );
+                
+        }
+        
+        __attribute__((target("avx2")))
+        bool DecodeAVX2(const char * src, std::size_t len, char separator, unsigned char * dst) {
+            
+            std::size_t i = 0;
+            
+            __m256i bad = _mm256_setzero_si256();
+            __m256i sep = _mm256_set1_epi8(separator);
+            
+            for (; (i + 32u) * 3u <= len; i += 32u) {
+                
+                const char * p = src + i * 3u;
+                
+                __m256i a = Load2x128(p,      p + 48);
+                __m256i b = Load2x128(p + 16, p + 64);
+                __m256i c = Load2x128(p + 32, p + 80);
+                
+                __m256i hi = NibblesAVX2(Gather3AVX2(a, b, c, MASKS.dec_hi), &bad);
+                __m256i lo = NibblesAVX2(Gather3AVX2(a, b, c, MASKS.dec_lo), &bad);
+                
+                bad = _mm256_or_si256(bad, _mm256_andnot_si256( _mm256_cmpeq_epi8(Gather3AVX2(a, b, c, MASKS.dec_sep), sep)
+                                                              , _mm256_set1_epi8(-1) ));
+                                                              
+                __m256i bytes = _mm256_or_si256(_mm256_slli_epi16(hi, 4), lo);
+                
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), bytes);
+                
+            }
+            
+            if (_mm256_movemask_epi8(bad) != 0) return false;
+            
+            // (Up to one more SSSE3-sized block, then scalar)
+            return DecodeSSSE3(src + i * 3u, len - i * 3u, separator, dst + i);
+            
+        }
+        
+        __attribute__((target("avx2")))
+        inline __m256i DigitsAVX2(__m256i nib) {
+            
+            __m256i adj = _mm256_and_si256(_mm256_cmpgt_epi8(nib, _mm256_set1_epi8(9)), _mm256_set1_epi8('A' - '0' - 10));
+            
+            return _mm256_add_epi8(_mm256_add_epi8(nib, _mm256_set1_epi8('0')), adj);
+            
+        }
+        
+        __attribute__((target("avx2")))
+        void EncodeAVX2(const unsigned char * src, std::size_t n, char separator, char * dst) {
+            
+            std::size_t i = 0;
+            
+            __m256i sep = _mm256_set1_epi8(separator);
+            __m256i low = _mm256_set1_epi8(0x0F);
+            
+            for (; i + 32u < n; i += 32u) {
+                
+                __m256i x  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i hi = DigitsAVX2(_mm256_and_si256(_mm256_srli_epi16(x, 4), low));
+                __m256i lo = DigitsAVX2(_mm256_and_si256(x, low));
+                
+                char * p = dst + i * 3u;
+                
+                for (int k = 0; k < 3; k += 1) {
+                    
+                    __m256i out = _mm256_or_si256(
+                        _mm256_or_si256( _mm256_shuffle_epi8(hi, Mask256(MASKS.enc_hi[k]))
+                                       , _mm256_shuffle_epi8(lo, Mask256(MASKS.enc_lo[k])) ),
+                        _mm256_and_si256(sep, Mask256(MASKS.enc_sep[k])) );
+                        
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16 * k),      _mm256_castsi256_si128(out));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16 * k + 48), _mm256_extracti128_si256(out, 1));
+                    
+                }
+                
+            }
+            
+            EncodeSSSE3(src + i, n - i, separator, dst + i * 3u);
+            
+        }
+
+#endif /* HEX_X86 */
+
+        ////////////////////////////////////////////////////////////////////////
+        
+        bool Supported(HexKernel kernel) {
+
+#if HEX_X86
+            __builtin_cpu_init();
+            
+            switch (kernel) {
+                case HEX_AVX2:  return __builtin_cpu_supports("avx2");
+                case HEX_SSSE3: return __builtin_cpu_supports("ssse3");
+                default:        return true;
+            }
+#else
+            return kernel == HEX_SCALAR;
+#endif
+
+        }
+        
+        struct Dispatch {
+            
+            HexKernel  kernel;
+            DecodeFunc decode;
+            EncodeFunc encode;
+            
+            Dispatch() {
+                
+                if (!select(HEX_AVX2) && !select(HEX_SSSE3)) select(HEX_SCALAR);
+                
+            }
+            
+            bool select(HexKernel k) {
+                
+                if (!Supported(k)) return false;
+                
+                kernel = k;
+                
+                switch (k) {
+#if HEX_X86
+                    case HEX_AVX2:  decode = DecodeAVX2;  encode = EncodeAVX2;  break;
+                    case HEX_SSSE3: decode = DecodeSSSE3; encode = EncodeSSSE3; break;
+#endif
+                    default: decode = DecodeScalarAll; encode = EncodeScalarAll; break;
+                }
+                
+                return true;
+                
+            }
+            
+        };
+        
+        Dispatch & Current() {
+            
+            static Dispatch dispatch{};
+            
+            return dispatch;
+            
+        }
+        
+    }
+    
+    bool hex_decode(const char * src, std::size_t len, char separator, unsigned char * dst) {
+        
+        if (hex_decoded_size(len) == 0) return false;
+        
+        return Current().decode(src, len, separator, dst);
+        
+    }
+    
+    void hex_encode(const unsigned char * src, std::size_t n, char separator, char * dst) {
+        
+        if (n == 0) return;
+        
+        Current().encode(src, n, separator, dst);
+        
+    }
+    
+    HexKernel hex_kernel() {
+        
+        return Current().kernel;
+        
+    }
+    
+    bool hex_set_kernel(HexKernel kernel) {
+        
+        return Current().select(kernel);
+        
+    }
+    
+    const char * hex_kernel_name(HexKernel kernel) {
+        
+        switch (kernel) {
+            case HEX_AVX2:  return "AVX2";
+            case HEX_SSSE3: return "SSSE3";
+            default:        return "scalar";
+        }
+        
+    }
+    
+}
+
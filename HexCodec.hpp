@@ -0,0 +1,56 @@
+
+#ifndef HEXCODEC_HPP
+#define HEXCODEC_HPP
+
+#include <cstddef>
+
+namespace gen {
+    
+    // Hex codec for the section format of .se files: two (upper case on
+    // output, any case on input) hex digits per byte, separated by a single
+    // separator character, e.g. "00 F5 0A". Uses SSSE3 or AVX2 kernels when
+    // the CPU has them (picked once, at the first call) and scalar code
+    // otherwise.
+    
+    enum HexKernel {
+        
+        HEX_SCALAR,
+        HEX_SSSE3,
+        HEX_AVX2
+        
+    };
+    
+    // Number of bytes in len characters of the format (0 if malformed).
+    inline
+    std::size_t hex_decoded_size(std::size_t len) {
+        
+        return (len % 3u == 2u) ? (len + 1u) / 3u : 0u;
+        
+    }
+    
+    // Number of characters needed for n bytes.
+    inline
+    std::size_t hex_encoded_size(std::size_t n) {
+        
+        return (n == 0) ? 0u : (n * 3u - 1u);
+        
+    }
+    
+    // Writes hex_decoded_size(len) bytes to dst; returns false (dst contents
+    // unspecified) on a malformed string.
+    bool hex_decode(const char * src, std::size_t len, char separator, unsigned char * dst);
+    
+    // Writes hex_encoded_size(n) characters to dst (not NUL-terminated).
+    void hex_encode(const unsigned char * src, std::size_t n, char separator, char * dst);
+    
+    HexKernel hex_kernel();
+    
+    // Forces a kernel (for testing); returns false if the CPU lacks it.
+    bool hex_set_kernel(HexKernel kernel);
+    
+    const char * hex_kernel_name(HexKernel kernel);
+    
+}
+
+#endif /* HEXCODEC_HPP */
+
@@ -4,7 +4,6 @@
 
 #include <cstring>
 #include <type_traits>
-#include <c++/4.6/type_traits>
 
 namespace gen {
     
@@ -0,0 +1,193 @@
+
+#include "VM87-Batch.hpp"
+#include "VM87-Runtime.hpp"
+#include "VM87-Threaded.hpp"
+#include "VM87-Input.hpp"
+#include "VM87-Image.hpp"
+
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace vm87 {
+    
+    void LoadBatchList(const char * path, std::vector<BatchJob> & jobs) {
+        
+        std::ifstream file{path};
+        
+        if (!file.is_open())
+            throw LoadError( "Could not open batch list [" + std::string(path) +
+                             "] for reading." );
+                             
+        std::string line;
+        
+        while (std::getline(file, line)) {
+            
+            std::istringstream ss{line};
+            
+            BatchJob job;
+            
+            if (!(ss >> job.program) || job.program[0] == '#') continue;
+            
+            ss >> job.input;
+            
+            jobs.push_back(job);
+            
+        }
+        
+    }
+    
+    static void RunJob(const BatchJob & job, const BatchOptions & opt, BatchResult & res) {
+        
+        TIME_POINT t0 = CLOCK::now();
+        
+        Runtime rt{};
+        
+        rt.poll_every  = opt.poll_every;
+        rt.timer_every = opt.timer_every;
+        rt.use_getch   = false;
+        
+        rt.console.setPolicy(ConsoleOutput::FLUSH_POLL);
+        rt.console.setCapture(&res.output);
+        
+        InputThread input{};
+        
+        int fd = -1;
+        
+        res.status = 255;
+        
+        try {
+            
+            if (!job.input.empty()) {
+                
+                if ((fd = open(job.input.c_str(), O_RDONLY)) < 0)
+                    throw LoadError( "Could not open input file [" + job.input +
+                                     "] for reading." );
+                                     
+                input.start(fd);
+                rt.input = &input;
+                
+            }
+            
+            LoadProgram(rt, job.program.c_str());
+            
+            if (opt.threaded) {
+                
+                ThreadedEngine te{rt, opt.jit};
+                
+                te.runProgram();
+                
+            } else {
+                
+                rt.runProgram(/* do_debug */ false);
+                
+            }
+            
+            res.status = int(rt.state.regs[0] & 0xFFu);
+            
+        } catch (LoadError & ex) {
+            
+            res.error = std::string("Loading error: ") + ex.what();
+            
+        } catch (UnrecError & ex) {
+            
+            res.error = std::string("Unrecoverable error: ") + ex.what();
+            
+        } catch (ViolationError & ex) {
+            
+            res.error = std::string("Unhandled violation error: ") + ex.what();
+            
+        } catch (std::exception & ex) {
+            
+            res.error = std::string("Unnamed exception caught: ") + ex.what();
+            
+        } catch (...) {
+            
+            res.error = "Unknown exception caught: (no message available).";
+            
+        }
+        
+        input.stop();
+        
+        if (fd >= 0) close(fd);
+        
+        rt.console.flush();
+        
+        res.icount  = rt.state.icount;
+        res.wall_ms = std::chrono::duration<double, std::milli>(CLOCK::now() - t0).count();
+        
+    }
+    
+    void RunBatch
+        ( const std::vector<BatchJob> & jobs
+        , const BatchOptions & opt
+        , std::vector<BatchResult> & results
+        ) {
+        
+        results.assign(jobs.size(), BatchResult{255, 0, 0.0, "", ""});
+        
+        unsigned cnt = opt.jobs;
+        
+        if (cnt == 0) cnt = std::thread::hardware_concurrency();
+        if (cnt == 0) cnt = 1;
+        if (cnt > jobs.size()) cnt = unsigned(jobs.size());
+        
+        std::atomic<size_t> next{0};
+        
+        auto worker = [&]() {
+            for (size_t i; (i = next.fetch_add(1)) < jobs.size(); )
+                RunJob(jobs[i], opt, results[i]);
+        };
+        
+        std::vector<std::thread> pool;
+        
+        for (unsigned i = 1; i < cnt; i += 1)
+            pool.emplace_back(worker);
+            
+        worker();
+        
+        for (std::thread & t : pool)
+            t.join();
+            
+    }
+    
+    void WriteBatchReport
+        ( std::ostream & os
+        , const std::vector<BatchJob> & jobs
+        , const std::vector<BatchResult> & results
+        ) {
+        
+        size_t failed = 0;
+        
+        for (const BatchResult & res : results)
+            if (!res.error.empty()) failed += 1;
+            
+        os << "# vm87 batch report: " << jobs.size() << " programs, "
+           << failed << " failed\n";
+           
+        for (size_t i = 0; i < jobs.size(); i += 1) {
+            
+            const BatchResult & res = results[i];
+            
+            os << "\n== " << jobs[i].program << "\n";
+            if (!jobs[i].input.empty())
+                os << "input: "   << jobs[i].input << "\n";
+            os << "status: "      << res.status << "\n";
+            os << "icount: "      << res.icount << "\n";
+            os << "time_ms: "     << res.wall_ms << "\n";
+            if (!res.error.empty())
+                os << "error: "   << res.error << "\n";
+                
+            // Byte count first, so the output itself may contain anything:
+            os << "output: " << res.output.size() << "\n";
+            os << res.output << "\n";
+            
+        }
+        
+    }
+    
+}
+
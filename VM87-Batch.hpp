@@ -0,0 +1,59 @@
+
+#ifndef VM87_BATCH_HPP
+#define VM87_BATCH_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace vm87 {
+    
+    // Batch runner - runs many programs, each in its own Runtime, on a pool
+    // of worker threads (no ncurses; output is captured, see ConsoleOutput).
+    
+    struct BatchJob {
+        
+        std::string program;
+        std::string input;   // Keyboard input file (empty - none)
+        
+    };
+    
+    struct BatchResult {
+        
+        int status;                // r0 (low 8 bits), 255 on errors
+        unsigned long long icount; // Retired instructions
+        double wall_ms;
+        std::string output;        // Console output
+        std::string error;         // Error message (empty - none)
+        
+    };
+    
+    struct BatchOptions {
+        
+        unsigned jobs;      // Worker threads (0 - one per core)
+        bool threaded;
+        bool jit;
+        size_t poll_every;
+        size_t timer_every;
+        
+    };
+    
+    // List file: one "program.se [input_file]" per line ('#' - comment).
+    void LoadBatchList(const char * path, std::vector<BatchJob> & jobs);
+    
+    void RunBatch
+        ( const std::vector<BatchJob> & jobs
+        , const BatchOptions & opt
+        , std::vector<BatchResult> & results
+        ) ;
+        
+    void WriteBatchReport
+        ( std::ostream & os
+        , const std::vector<BatchJob> & jobs
+        , const std::vector<BatchResult> & results
+        ) ;
+        
+}
+
+#endif /* VM87_BATCH_HPP */
+
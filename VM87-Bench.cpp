@@ -0,0 +1,257 @@
+
+#include "VM87-Bench.hpp"
+#include "VM87-Runtime.hpp"
+#include "Asem-ELFHolder.hpp"
+#include "HexCodec.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace vm87 {
+    
+    using namespace asem;
+    
+    void GenerateLoaderInput(const std::string & path, size_t bytes) {
+        
+        std::FILE * file = std::fopen(path.c_str(), "wb");
+        
+        if (file == nullptr)
+            throw UnrecError("Could not open file [" + path + "] for writing.");
+            
+        unsigned seed = 87u;
+        
+        auto next = [&seed]() -> unsigned {
+            seed = seed * 1103515245u + 12345u;
+            return (seed >> 16) & 0x7FFFu;
+        };
+        
+        // ~1/4 symbols, ~1/4 relocation records, ~1/2 section bytes:
+        size_t sym_cnt = bytes / 4u / 32u + 1u;
+        size_t rel_cnt = bytes / 4u / 28u;
+        size_t sec_len = bytes / 2u / 3u / 2u; // Two sections
+        
+        std::fprintf(file, "#.symtab\n#Ord Name Value Section Scope RelTo\n");
+        std::fprintf(file, "\t0 UND ? Undef. Undef. Undef.\n");
+        
+        // (Every 8th line ends with CR LF)
+        for (size_t i = 1; i < sym_cnt; i += 1) {
+            std::fprintf( file, " %5u   sym_%-8u   %5u   %s   %s   %s %s\n"
+                        , unsigned(i), unsigned(i), next()
+                        , (i & 1u) ? "Text" : "Data"
+                        , (i & 2u) ? "Local" : "Global"
+                        , (i & 1u) ? "Text" : "Data"
+                        , (i % 8u == 0) ? "\r" : "" );
+        }
+        
+        const char * types[4] = { "R_ABS_08", "R_ABS_16", "R_ABS_32", "R_PCR_16" };
+        
+        for (size_t s = 0; s < 2u; s += 1) {
+            
+            std::fprintf(file, (s == 0) ? "#.ret.text\n" : "#.ret.data\n");
+            
+            for (size_t i = s; i < rel_cnt; i += 2u) {
+                std::fprintf( file, "0x%07X  %-8s  0x%04X%s\n"
+                            , unsigned(next()), types[next() & 3u]
+                            , unsigned(next() % sym_cnt)
+                            , (i % 8u == 0) ? "\r" : "" );
+            }
+            
+        }
+        
+        for (size_t s = 0; s < 2u; s += 1) {
+            
+            std::fprintf(file, (s == 0) ? "#.text\n" : "#.data\n");
+            
+            // (Every 64th byte separated by a tab)
+            for (size_t i = 0; i < sec_len; i += 1)
+                std::fprintf( file, (i + 1 == sec_len) ? "%02X\n" : (i % 64u == 63u) ? "%02X\t" : "%02X "
+                            , next() & 0xFFu );
+                
+        }
+        
+        std::fclose(file);
+        
+    }
+    
+    static
+    bool SameContents(const ELFHolder & a, const ELFHolder & b) {
+        
+        if (a.symtab.data.size() != b.symtab.data.size()) return false;
+        
+        const SymbolStore & sa = a.symtab.data;
+        
+        for (size_t i = 0; i < sa.ordinals(); i += 1) {
+            
+            if (!sa.has(i)) continue;
+            
+            const SymbolTableEntry * it = b.symtab.data.find(sa.name(i), sa.nameLength(i));
+            
+            if (it == nullptr) return false;
+            
+            const SymbolTableEntry & x = sa.entry(i);
+            const SymbolTableEntry & y = *it;
+            
+            if (x.ordinal != y.ordinal || x.scope != y.scope || x.section != y.section ||
+                x.relative_to != y.relative_to || x.defined != y.defined ||
+                (x.defined && x.value != y.value)) return false;
+                
+        }
+        
+        for (size_t i = 0; i < 4; i += 1) {
+            
+            if (a.sections[i].data != b.sections[i].data) return false;
+            
+            if (a.relocations[i].size() != b.relocations[i].size()) return false;
+            
+            auto it = b.relocations[i].begin();
+            
+            for (const RelocRecord & rr : a.relocations[i]) {
+                
+                if (rr.type != it->type || rr.offset != it->offset || rr.value != it->value)
+                    return false;
+                    
+                ++it;
+                
+            }
+            
+        }
+        
+        return true;
+        
+    }
+    
+    // Small inputs the generated file doesn't cover (tabs and CRs inside
+    // lines, blank separators the fast path leaves to the slow one):
+    static const char * const EDGE_CASES[] = 
+        { "#.text\n00 11\t22 33\n"
+        , "#.data\n\t00\t11 22\t\n"
+        , "#.text\n00 11\t\t22\n"
+        , "#.text\n00 11\r\n"
+        , "#.text\r\n00 11\n"
+        , "#.symtab\n0 UND ? Undef. Undef. Undef.\r\n1 a\t4 Text Global Text\r\n"
+          "#.ret.text\n0x0\tR_ABS_16 0x1\r\n#.text\n00 00\r"
+        } ;
+        
+    // Both loaders fail on the text, or both produce the same contents?
+    static
+    bool SameOnText(const char * path, const char * text) {
+        
+        std::FILE * file = std::fopen(path, "wb");
+        
+        if (file == nullptr)
+            throw UnrecError(std::string{"Could not open file ["} + path + "] for writing.");
+            
+        std::fputs(text, file);
+        std::fclose(file);
+        
+        ELFHolder legacy{};
+        ELFHolder fast{};
+        
+        bool ok_legacy = true;
+        bool ok_fast   = true;
+        
+        try { legacy.loadFromFileLegacy(path); } catch (const std::exception &) { ok_legacy = false; }
+        try { fast.loadFromFile(path);         } catch (const std::exception &) { ok_fast   = false; }
+        
+        if (ok_legacy != ok_fast) return false;
+        
+        return !ok_legacy || SameContents(legacy, fast);
+        
+    }
+    
+    template <typename Func>
+    static
+    double BestMs(unsigned reps, Func func) {
+        
+        double best = 0.0;
+        
+        for (unsigned i = 0; i < reps; i += 1) {
+            
+            TIME_POINT t0 = CLOCK::now();
+            
+            func();
+            
+            double ms = std::chrono::duration<double, std::milli>(CLOCK::now() - t0).count();
+            
+            if (i == 0 || ms < best) best = ms;
+            
+        }
+        
+        return best;
+        
+    }
+    
+    bool RunLoaderBenchmark(std::ostream & os, size_t bytes, unsigned reps) {
+        
+        char path[] = "/tmp/vm87_loadbench_XXXXXX";
+        
+        int fd = mkstemp(path);
+        
+        if (fd < 0) throw UnrecError("Could not create a temporary file.");
+        
+        close(fd);
+        
+        GenerateLoaderInput(path, bytes);
+        
+        ELFHolder legacy{};
+        ELFHolder fast{};
+        
+        double ms_legacy = 0.0;
+        double ms_fast   = 0.0;
+        double ms_reloc  = 0.0;
+        bool   same      = false;
+        
+        try {
+            
+            ms_legacy = BestMs(reps, [&]() { legacy.loadFromFileLegacy(path); });
+            ms_fast   = BestMs(reps, [&]() { fast.loadFromFile(path); });
+            
+            same = SameContents(legacy, fast);
+            
+            // Relocation pass alone (into an empty memory image):
+            Runtime rt{};
+            
+            ms_reloc = BestMs(reps, [&]() {
+                std::vector<int> symvals;
+                fast.symtab.toValueVector(symvals);
+                for (size_t i = 0; i < 4; i += 1)
+                    rt.applyRelocations(fast.relocations[i], symvals);
+            });
+            
+            for (const char * text : EDGE_CASES)
+                same = SameOnText(path, text) && same;
+            
+        } catch (...) {
+            
+            unlink(path);
+            
+            throw;
+            
+        }
+        
+        unlink(path);
+        
+        size_t rel_cnt = 0;
+        for (size_t i = 0; i < 4; i += 1) rel_cnt += fast.relocations[i].size();
+        
+        os << "Input:    " << bytes / 1000000.0 << " MB ("
+           << fast.symtab.data.size() << " symbols, " << rel_cnt << " relocations, "
+           << fast.sections[Section::Text].data.size() +
+              fast.sections[Section::Data].data.size() << " section bytes)\n";
+        os << "Legacy:   " << ms_legacy << " ms\n";
+        os << "Fast:     " << ms_fast   << " ms\n";
+        os << "Speedup:  " << (ms_fast > 0.0 ? ms_legacy / ms_fast : 0.0) << "x\n";
+        os << "Relocate: " << ms_reloc  << " ms\n";
+        os << "Hex:      " << gen::hex_kernel_name(gen::hex_kernel()) << "\n";
+        os << "Contents: " << (same ? "identical" : "DIFFERENT") << "\n";
+        
+        return same;
+        
+    }
+    
+}
+
@@ -0,0 +1,25 @@
+
+#ifndef VM87_BENCH_HPP
+#define VM87_BENCH_HPP
+
+#include <string>
+#include <ostream>
+
+namespace vm87 {
+    
+    // Loader benchmark (vm87 loadbench): generates a .se file of about the
+    // given size (symbols, relocation records and section bytes), loads it
+    // with each loader, checks that they agree (on a few small inputs with
+    // tabs and CRs inside lines as well) and reports the best times (plus
+    // the time of the relocation pass over the loaded records).
+    
+    // Writes a generated .se file (deterministic for a given size).
+    void GenerateLoaderInput(const std::string & path, size_t bytes);
+    
+    // Returns false if the loaders produced different contents.
+    bool RunLoaderBenchmark(std::ostream & os, size_t bytes, unsigned reps);
+    
+}
+
+#endif /* VM87_BENCH_HPP */
+
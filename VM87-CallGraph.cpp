@@ -0,0 +1,201 @@
+
+#include "VM87-CallGraph.hpp"
+#include "VM87-SymIndex.hpp"
+
+#include <algorithm>
+#include <string>
+#include <cstdio>
+
+namespace vm87 {
+    
+    const std::uint32_t CallGraph::NO_SLOT;
+    
+    CallGraph::CallGraph(const SymbolIndex & symbols)
+        : symbols(symbols)
+        , mark(0) {
+        
+        nodes.push_back(Node{0, 0, 0});
+        
+    }
+    
+    std::uint32_t CallGraph::function(std::uint16_t addr) const {
+        
+        std::uint32_t i = symbols.find(addr);
+        
+        return (i == SymbolIndex::NONE) ? std::uint32_t(symbols.size()) : i;
+        
+    }
+    
+    const char * CallGraph::functionName(std::uint32_t func) const {
+        
+        return (func < symbols.size()) ? symbols.name(symbols.at(func)) : "<unknown>";
+        
+    }
+    
+    void CallGraph::charge(unsigned long long icount) {
+        
+        if (!stack.empty()) {
+            
+            unsigned long long delta = icount - mark;
+            
+            nodes[stack.back().node].self   += delta;
+            funcs[stack.back().func].exclusive += delta;
+            
+        }
+        
+        mark = icount;
+        
+    }
+    
+    void CallGraph::push(std::uint32_t func, std::uint32_t sp, unsigned long long icount) {
+        
+        std::uint32_t parent = stack.empty() ? 0u : stack.back().node;
+        
+        std::uint64_t key = (std::uint64_t(parent) << 32) | func;
+        
+        auto it = children.find(key);
+        
+        std::uint32_t node;
+        
+        if (it == children.end()) {
+            node = std::uint32_t(nodes.size());
+            nodes.push_back(Node{parent, func, 0});
+            children.emplace(key, node);
+        } else {
+            node = it->second;
+        }
+        
+        stack.push_back(Frame{node, func, sp, icount});
+        
+        FuncStats & fs = funcs[func];
+        
+        fs.calls  += 1;
+        fs.active += 1;
+        
+    }
+    
+    void CallGraph::pop(unsigned long long icount) {
+        
+        const Frame & f = stack.back();
+        
+        FuncStats & fs = funcs[f.func];
+        
+        // Only the outermost activation counts (recursion is inside it):
+        if (--fs.active == 0) fs.inclusive += icount - f.entry;
+        
+        stack.pop_back();
+        
+    }
+    
+    void CallGraph::start(std::uint16_t pc, unsigned long long icount) {
+        
+        funcs.assign(symbols.size() + 1u, FuncStats{0, 0, 0, 0});
+        
+        mark = icount;
+        
+        push(function(pc), NO_SLOT, icount);
+        
+    }
+    
+    void CallGraph::enter(std::uint16_t target, std::uint16_t sp, unsigned long long icount) {
+        
+        if (stack.empty()) return; // (Not started)
+        
+        charge(icount);
+        
+        // Frames whose return slot is at or below sp were abandoned:
+        while (stack.back().sp <= sp) pop(icount);
+        
+        push(function(target), sp, icount);
+        
+    }
+    
+    void CallGraph::leave(std::uint16_t sp, unsigned long long icount) {
+        
+        if (stack.empty()) return;
+        
+        // The frame returning is the one whose return address is at sp (a
+        // pop pc without one is a jump, not a return):
+        size_t i = stack.size();
+        
+        while (i > 0 && stack[i - 1].sp < sp) i -= 1;
+        
+        if (i == 0 || stack[i - 1].sp != sp) return;
+        
+        charge(icount);
+        
+        while (stack.size() >= i) pop(icount);
+        
+    }
+    
+    void CallGraph::finish(unsigned long long icount) {
+        
+        charge(icount);
+        
+        while (!stack.empty()) pop(icount);
+        
+    }
+    
+    void CallGraph::writeReport(std::ostream & os) const {
+        
+        unsigned long long total = 0;
+        
+        for (const FuncStats & fs : funcs) total += fs.exclusive;
+        
+        std::vector<size_t> order;
+        
+        for (size_t i = 0; i < funcs.size(); i += 1)
+            if (funcs[i].calls != 0) order.push_back(i);
+            
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return funcs[a].inclusive > funcs[b].inclusive;
+        });
+        
+        os << "# vm87 call graph: " << total << " instructions retired, "
+           << (nodes.size() - 1u) << " calling contexts\n";
+        os << "#    Calls    Inclusive       %    Exclusive       %   Function\n";
+        
+        char buffer[128];
+        
+        for (size_t i : order) {
+            
+            const FuncStats & fs = funcs[i];
+            
+            std::snprintf(buffer, sizeof(buffer), "%10llu %12llu %6.2f%% %12llu %6.2f%%   "
+                         , fs.calls
+                         , fs.inclusive, total ? 100.0 * double(fs.inclusive) / double(total) : 0.0
+                         , fs.exclusive, total ? 100.0 * double(fs.exclusive) / double(total) : 0.0
+                         );
+                         
+            os << buffer << functionName(std::uint32_t(i)) << "\n";
+            
+        }
+        
+    }
+    
+    void CallGraph::writeFolded(std::ostream & os) const {
+        
+        std::vector<const char *> path;
+        
+        for (size_t n = 1; n < nodes.size(); n += 1) {
+            
+            if (nodes[n].self == 0) continue;
+            
+            path.clear();
+            
+            for (std::uint32_t t = std::uint32_t(n); t != 0; t = nodes[t].parent)
+                path.push_back(functionName(nodes[t].func));
+                
+            for (size_t i = path.size(); i > 0; i -= 1) {
+                os << path[i - 1];
+                os << ((i > 1) ? ';' : ' ');
+            }
+            
+            os << nodes[n].self << "\n";
+            
+        }
+        
+    }
+    
+}
+
@@ -0,0 +1,105 @@
+
+#ifndef VM87_CALLGRAPH_HPP
+#define VM87_CALLGRAPH_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+namespace vm87 {
+    
+    class SymbolIndex;
+    
+    // Call-graph profile (see Runtime::callgraph). Keeps a shadow call stack
+    // from the events of the run loop - Call and interrupt entry push a
+    // frame, RetP (pop pc) and Iret pop one - and charges the instructions
+    // retired between two events to the frame on top. Frames are matched by
+    // the stack slot of their return address, so frames the guest abandons
+    // (by moving SP) are dropped at the next event that passes them.
+    //
+    // Functions are the intervals of a SymbolIndex (the index must outlive
+    // the call graph and be built before the run starts). Time is kept per
+    // calling context (a node per distinct call path), which gives exclusive
+    // counts per function and the folded stacks of flame graph tools.
+    class CallGraph {
+    
+    public:
+        
+        explicit CallGraph(const SymbolIndex & symbols);
+        
+        // Base frame (the code running at pc when the run starts):
+        void start(std::uint16_t pc, unsigned long long icount);
+        
+        // Call or interrupt entry (sp - SP after the return address push):
+        void enter(std::uint16_t target, std::uint16_t sp, unsigned long long icount);
+        
+        // RetP or Iret (sp - SP before the instruction):
+        void leave(std::uint16_t sp, unsigned long long icount);
+        
+        // Closes all frames (at the end of the run, again is harmless):
+        void finish(unsigned long long icount);
+        
+        // Calls, inclusive and exclusive retired instructions per function:
+        void writeReport(std::ostream & os) const;
+        
+        // "caller;callee;... count" lines (flamegraph.pl, speedscope, ...):
+        void writeFolded(std::ostream & os) const;
+        
+    private:
+        
+        static const std::uint32_t NO_SLOT = 0x10000u; // (Base frame, never returns)
+        
+        struct Frame {
+            
+            std::uint32_t      node;
+            std::uint32_t      func;
+            std::uint32_t      sp;    // Slot of the return address
+            unsigned long long entry; // icount at entry
+            
+        };
+        
+        struct Node {
+            
+            std::uint32_t      parent;
+            std::uint32_t      func;
+            unsigned long long self;
+            
+        };
+        
+        struct FuncStats {
+            
+            unsigned long long calls;
+            unsigned long long inclusive;
+            unsigned long long exclusive;
+            unsigned           active; // Activations on the stack (recursion)
+            
+        };
+        
+        const SymbolIndex & symbols;
+        
+        std::vector<Frame>     stack;
+        std::vector<Node>      nodes; // [0] - root (no function)
+        std::vector<FuncStats> funcs; // By interval, then <unknown>
+        
+        std::unordered_map<std::uint64_t, std::uint32_t> children; // (parent, func) -> node
+        
+        unsigned long long mark; // icount charged so far
+        
+        std::uint32_t function(std::uint16_t addr) const;
+        
+        const char * functionName(std::uint32_t func) const;
+        
+        void charge(unsigned long long icount);
+        
+        void push(std::uint32_t func, std::uint32_t sp, unsigned long long icount);
+        
+        void pop(unsigned long long icount);
+        
+    };
+    
+}
+
+#endif /* VM87_CALLGRAPH_HPP */
+
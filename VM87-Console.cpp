@@ -0,0 +1,109 @@
+
+#include "VM87-Console.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <ncurses.h>
+
+namespace vm87 {
+    
+    ConsoleOutput::ConsoleOutput()
+        : policy(FLUSH_LINE)
+        , file(nullptr)
+        , capture(nullptr)
+        , used(0)
+        { }
+    
+    void ConsoleOutput::setPolicy(Policy p) {
+        
+        flush();
+        
+        policy = p;
+        
+    }
+    
+    void ConsoleOutput::setFile(std::FILE * f) {
+        
+        flush();
+        
+        file = f;
+        
+    }
+    
+    void ConsoleOutput::setCapture(std::string * str) {
+        
+        flush();
+        
+        capture = str;
+        
+    }
+    
+    void ConsoleOutput::write(const char * str, size_t len) {
+        
+        if (capture != nullptr) {
+            capture->append(str, len);
+        } else if (file != nullptr) {
+            std::fwrite(str, 1, len, file);
+            std::fflush(file);
+        } else {
+            addnstr(str, int(len));
+            refresh();
+        }
+        
+    }
+    
+    void ConsoleOutput::flush() {
+        
+        if (used == 0) return;
+        
+        if (policy == FLUSH_DEBUG) {
+            
+            char text[32];
+            
+            for (size_t i = 0; i < used; i += 1) {
+                std::snprintf(text, sizeof(text), "CONSOLE OUTPUT: %c\n", buffer[i]);
+                write(text, std::strlen(text));
+            }
+            
+        } else {
+            
+            write(buffer, used);
+            
+        }
+        
+        used = 0;
+        
+    }
+    
+    int ConsoleOutput::print(const char * format, ...) {
+        
+        char text[1024];
+        
+        va_list args;
+        va_start(args, format);
+        
+        int rv = std::vsnprintf(text, sizeof(text), format, args);
+        
+        va_end(args);
+        
+        flush();
+        
+        write(text, std::strlen(text));
+        
+        return rv;
+        
+    }
+    
+    bool ConsoleOutput::ParsePolicy(const char * str, Policy & p) {
+        
+        if (std::strcmp(str, "each") == 0) { p = FLUSH_EACH; return true; }
+        if (std::strcmp(str, "line") == 0) { p = FLUSH_LINE; return true; }
+        if (std::strcmp(str, "poll") == 0) { p = FLUSH_POLL; return true; }
+        
+        return false;
+        
+    }
+    
+}
+
@@ -0,0 +1,78 @@
+
+#ifndef VM87_CONSOLE_HPP
+#define VM87_CONSOLE_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace vm87 {
+    
+    // Console output device (stores to 0xFFFE). Characters are collected in a
+    // buffer at memory speed and written to the screen in bulk (one addnstr
+    // and refresh) according to the flush policy. flush() must also be called
+    // before anything else is printed and before exiting.
+    //
+    // In headless mode (setFile) the output goes to a plain file/stdout and
+    // the batch runner captures it in a string (setCapture). All printing
+    // done on behalf of a Runtime goes through its own ConsoleOutput (see
+    // print), so separate Runtime instances share no output state.
+    class ConsoleOutput {
+    
+    public:
+        
+        enum Policy {
+            FLUSH_DEBUG, // Every character, as debug info (debug mode)
+            FLUSH_EACH, // Every character (unbuffered)
+            FLUSH_LINE, // Newline, full buffer, interrupt poll points
+            FLUSH_POLL  // Full buffer, interrupt poll points
+        };
+        
+        static const size_t BUFFER_SIZE = 4096u;
+        
+        ConsoleOutput();
+        
+        Policy getPolicy() const { return policy; }
+        void   setPolicy(Policy p);
+        
+        void setFile(std::FILE * f);       // nullptr - ncurses
+        void setCapture(std::string * str); // nullptr - file/ncurses
+        
+        void put(char c) {
+            
+            buffer[used++] = c;
+            
+            if (used == BUFFER_SIZE || policy <= FLUSH_EACH ||
+                (c == '\n' && policy == FLUSH_LINE))
+                flush();
+                
+        }
+        
+        void poll() { if (used != 0) flush(); } // At interrupt poll points
+        
+        void flush();
+        
+        // Formatted text (debug info), printed right away:
+        int print(const char * format, ...);
+        
+        static bool ParsePolicy(const char * str, Policy & p);
+        
+    private:
+        
+        Policy policy;
+        
+        std::FILE * file;
+        std::string * capture;
+        
+        size_t used;
+        
+        char buffer[BUFFER_SIZE];
+        
+        void write(const char * str, size_t len);
+        
+    };
+    
+}
+
+#endif /* VM87_CONSOLE_HPP */
+
@@ -0,0 +1,80 @@
+
+#include "VM87-Counters.hpp"
+#include "VM87-Runtime.hpp"
+
+#include <cstdio>
+
+namespace vm87 {
+    
+    PerfCounters::PerfCounters() {
+        
+        clear();
+        
+    }
+    
+    void PerfCounters::clear() {
+        
+        skipped       = 0;
+        loads         = 0;
+        stores        = 0;
+        violations    = 0;
+        console_bytes = 0;
+        
+        for (size_t i = 0; i < 8; i += 1) {
+            irq_raised[i] = 0;
+            irq_taken [i] = 0;
+        }
+        
+    }
+    
+    std::string PerfCountersToString(const Runtime & rt, double wall_seconds) {
+        
+        static const char * names[8] =
+            { "init", "timer", "violation", "keystroke", "4", "5", "6", "7" };
+            
+        const PerfCounters & c = rt.counters;
+        
+        unsigned long long retired = rt.state.icount;
+        
+        char buffer[160];
+        
+        std::string rv;
+        
+        auto line = [&](const char * name, unsigned long long value) {
+            std::snprintf(buffer, sizeof(buffer), "%-22s %15llu\n", name, value);
+            rv += buffer;
+        };
+        
+        rv += "# vm87 counters\n";
+        
+        line("instructions_retired", retired);
+        line("instructions_skipped", c.skipped);
+        line("memory_loads",         c.loads);
+        line("memory_stores",        c.stores);
+        line("violation_traps",      c.violations);
+        line("console_bytes",        c.console_bytes);
+        
+        for (size_t i = 0; i < 8; i += 1) {
+            
+            if (c.irq_raised[i] == 0 && c.irq_taken[i] == 0) continue;
+            
+            std::snprintf(buffer, sizeof(buffer), "interrupt_%-11s %15llu raised %15llu taken\n"
+                         , names[i], c.irq_raised[i], c.irq_taken[i]);
+                         
+            rv += buffer;
+            
+        }
+        
+        std::snprintf(buffer, sizeof(buffer), "%-22s %15.3f\n", "wall_time_s", wall_seconds);
+        rv += buffer;
+        
+        std::snprintf(buffer, sizeof(buffer), "%-22s %15.3f\n", "mips"
+                     , (wall_seconds > 0.0) ? double(retired) / wall_seconds / 1e6 : 0.0);
+        rv += buffer;
+        
+        return rv;
+        
+    }
+    
+}
+
@@ -0,0 +1,39 @@
+
+#ifndef VM87_COUNTERS_HPP
+#define VM87_COUNTERS_HPP
+
+#include <string>
+
+namespace vm87 {
+    
+    class Runtime;
+    
+    // Performance counters of a Runtime (always on - each one is a single
+    // increment at a place the work is done anyway). Instructions retired
+    // are ProcessorState::icount. Memory accesses are counted by memLoad /
+    // memStore and skipped instructions by the interpreters; code compiled
+    // by the JIT adds the accesses of a block (known when it is compiled)
+    // when the block is left, and its skipped instructions as they happen.
+    struct PerfCounters {
+        
+        unsigned long long skipped;       // Retired with a failed predicate
+        unsigned long long loads;         // Memory words read
+        unsigned long long stores;        // Memory words written
+        unsigned long long violations;    // Violation traps (access, division by zero)
+        unsigned long long irq_raised[8]; // Per interrupt vector
+        unsigned long long irq_taken[8];  // Per interrupt vector (handler called)
+        unsigned long long console_bytes; // Written to 0xFFFE
+        
+        PerfCounters();
+        
+        void clear();
+        
+    };
+    
+    // Multi-line report (wall_seconds - host time of the run, for MIPS):
+    std::string PerfCountersToString(const Runtime & rt, double wall_seconds);
+    
+}
+
+#endif /* VM87_COUNTERS_HPP */
+
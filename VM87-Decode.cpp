@@ -0,0 +1,59 @@
+
+#include "VM87-Decode.hpp"
+#include "Asem-Enumeration.hpp"
+#include "Asem-Func.hpp"
+
+#include <vector>
+
+using namespace asem;
+
+namespace vm87 {
+    
+    InstructionDesc::InstructionDesc(unsigned short e) {
+        
+        pred = static_cast<unsigned char>((e >> 14) & 0x3);
+        id   = static_cast<unsigned char>(((e >> 10) & 0xF) + Command::Add);
+        
+        dst_am = static_cast<unsigned char>((e >> 8) & 0x3);
+        src_am = static_cast<unsigned char>((e >> 3) & 0x3);
+        
+        dst_reg_no = static_cast<unsigned char>((e >> 5) & 0x7);
+        src_reg_no = static_cast<unsigned char>((e >> 0) & 0x7);
+        
+        bool dst, src;
+        
+        InstructionOperands(getId(), dst, src);
+        
+        has_data = ((dst && (dst_am != AddrMode::RegDir)) ||
+                    (src && (src_am != AddrMode::RegDir)));
+        
+        handler = static_cast<unsigned char>(ExecHandlerIndex(e));
+        
+    }
+    
+    InstructionDesc::InstructionDesc()
+        : InstructionDesc(0u)
+        { }
+    
+    static std::vector<InstructionDesc> BuildDecodeTable() {
+        
+        std::vector<InstructionDesc> rv;
+        
+        rv.reserve(DECODE_TABLE_SIZE);
+        
+        for (unsigned e = 0; e < DECODE_TABLE_SIZE; e += 1)
+            rv.emplace_back( static_cast<unsigned short>(e) );
+        
+        return rv;
+        
+    }
+    
+    const InstructionDesc * DecodeTable() {
+        
+        static const std::vector<InstructionDesc> table = BuildDecodeTable();
+        
+        return &table[0];
+        
+    }
+    
+}
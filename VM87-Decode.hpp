@@ -0,0 +1,64 @@
+
+#ifndef VM87_DECODE_HPP
+#define VM87_DECODE_HPP
+
+#include "Asem-Enumeration.hpp"
+
+namespace vm87 {
+    
+    // Compact (8 byte) predecoded form of a single instruction word. Every
+    // one of the 65536 possible encodings has its own entry in the decode
+    // table, so fetching is reduced to one indexed load.
+    struct InstructionDesc {
+        
+        unsigned char pred;   // asem::Predicate::Enum
+        unsigned char id;     // asem::Command::Enum
+        unsigned char dst_am; // asem::AddrMode::Enum
+        unsigned char src_am; // asem::AddrMode::Enum
+        
+        unsigned char dst_reg_no;
+        unsigned char src_reg_no;
+        
+        unsigned char has_data; // A data word follows the instruction word
+        unsigned char handler;  // Index of the execute handler (opcode, dst_am, src_am)
+        
+        InstructionDesc();
+        
+        InstructionDesc(unsigned short encoded);
+        
+        asem::Predicate::Enum getPred() const {
+            return static_cast<asem::Predicate::Enum>(pred);
+        }
+        
+        asem::Command::Enum getId() const {
+            return static_cast<asem::Command::Enum>(id);
+        }
+        
+        asem::AddrMode::Enum getDstAM() const {
+            return static_cast<asem::AddrMode::Enum>(dst_am);
+        }
+        
+        asem::AddrMode::Enum getSrcAM() const {
+            return static_cast<asem::AddrMode::Enum>(src_am);
+        }
+        
+    };
+    
+    // Opcode (bits 13..10), dst (9..8) and src (4..3) addressing mode of an
+    // instruction word, as opcode << 4 | dst_am << 2 | src_am:
+    inline
+    unsigned ExecHandlerIndex(unsigned short encoded) {
+        
+        return ((encoded >> 6) & 0xFCu) | ((encoded >> 3) & 0x3u);
+        
+    }
+    
+    static const unsigned DECODE_TABLE_SIZE = 65536u;
+    
+    // Table of all 65536 predecoded encodings (built once, on first use).
+    const InstructionDesc * DecodeTable();
+    
+}
+
+#endif /* VM87_DECODE_HPP */
+
@@ -3,11 +3,401 @@
 #define VM87_FUNCRT_HPP
 
 #include "VM87-Runtime.hpp"
+#include "Asem-Enumeration.hpp"
+#include "Punning.hpp"
 
 namespace vm87 {
     
+    // Execute handlers - one per (opcode, dst addressing mode, src addressing
+    // mode), indexed by InstructionDesc::handler (see ExecHandlerIndex). Each
+    // is an instance of an Exec* template below with the operand access
+    // resolved at compile time, so a register to register form is reduced to
+    // a couple of register file accesses. Shared by the reference interpreter
+    // (Runtime::executeInstruction) and the threaded engine so that both have
+    // exactly the same semantics. Handlers don't check the predicate (see
+    // CheckPredicate) and return false on a fault (recorded in Runtime::fault,
+    // the instruction is left where the fault stopped it).
+    
+    typedef bool (*ExecHandler)(Runtime & rt, const InstructionDesc & desc, USHORT data);
+    
+    static const unsigned EXEC_HANDLER_COUNT = 256u;
+    
+    extern const ExecHandler EXEC_HANDLERS[EXEC_HANDLER_COUNT];
+    
+    inline
+    bool CheckPredicate(const ProcessorState & state, unsigned pred) {
+        
+        switch (pred) {
+            case asem::Predicate::Eq:
+                return state.getZF();
+            case asem::Predicate::Ne:
+                return !state.getZF();
+            case asem::Predicate::Gt:
+                return !(state.getNF() || state.getZF());
+            default:
+                return true;
+        }
+        
+    }
+    
+    // Flags: //////////////////////////////////////////////////////////////////
+    
+    // (Only recorded, see ProcessorState - lazy flags)
+    
+    inline
+    void FlagsZN(ProcessorState & state, short res_s) {
+        
+        state.lazyZN(res_s);
+        
+    }
+    
+    inline
+    void FlagsAdd(ProcessorState & state, short dst_s, short src_s, short res_s) {
+        
+        state.lazyArith(ProcessorState::LF_ADD, dst_s, src_s, res_s);
+        
+    }
+    
+    inline
+    void FlagsSub(ProcessorState & state, short dst_s, short src_s, short res_s) {
+        
+        state.lazyArith(ProcessorState::LF_SUB, dst_s, src_s, res_s);
+        
+    }
+    
+    // Operands: ////////////////////////////////////////////////////////////////
+    
+    // (AM - asem::AddrMode::Enum, an operand without a data word ignores it;
+    //  false - fault, see Runtime::memLoad / memStore)
+    
+    template <unsigned AM>
+    inline
+    bool LoadUnsigned(Runtime & rt, unsigned reg_no, USHORT data, USHORT & value) {
+        
+        switch (AM) {
+            
+            case asem::AddrMode::Imm:
+                value = (reg_no == 0x7) ? rt.state.getPSW() : data;
+                return true;
+                
+            case asem::AddrMode::MemDir:
+                return rt.memLoad(data, value);
+                
+            case asem::AddrMode::RegDir:
+                value = rt.state.regs[reg_no];
+                return true;
+                
+            default: // RegInd
+                return rt.memLoad(rt.state.regs[reg_no] + data, value);
+            
+        }
+        
+    }
+    
+    template <unsigned AM>
+    inline
+    bool LoadSigned(Runtime & rt, unsigned reg_no, USHORT data, short & value) {
+        
+        USHORT temp;
+        
+        if (!LoadUnsigned<AM>(rt, reg_no, data, temp)) return false;
+        
+        value = gen::pun_u_to_s<short>(temp);
+        
+        return true;
+        
+    }
+    
+    template <unsigned AM>
+    inline
+    bool StoreUnsigned(Runtime & rt, unsigned reg_no, USHORT data, USHORT value) {
+        
+        switch (AM) {
+            
+            case asem::AddrMode::Imm:
+                if (reg_no == 0x7)
+                    rt.state.setPSW(value);
+                else {
+                    /* STUB - ERROR */
+                }
+                return true;
+                
+            case asem::AddrMode::MemDir:
+                return rt.memStore(data, value);
+                
+            case asem::AddrMode::RegDir:
+                rt.state.regs[reg_no] = value;
+                return true;
+                
+            default: // RegInd
+                return rt.memStore(rt.state.regs[reg_no] + data, value);
+            
+        }
+        
+    }
+    
+    template <unsigned AM>
+    inline
+    bool StoreSigned(Runtime & rt, unsigned reg_no, USHORT data, short value) {
+        
+        return StoreUnsigned<AM>(rt, reg_no, data, gen::pun_s_to_u<short>(value));
+        
+    }
+    
+    // Handlers: ///////////////////////////////////////////////////////////////
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecAdd(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s + src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsAdd(rt.state, dst_s, src_s, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecSub(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s - src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsSub(rt.state, dst_s, src_s, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecMul(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s * src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecDiv(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        if (src_s == 0)
+            return rt.setFault(Fault::DIVIDE, 0);
+        short res_s = dst_s / src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecCmp(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s - src_s;
+        
+        FlagsSub(rt.state, dst_s, src_s, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecAnd(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s & src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecOr(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s | src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecNot(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short src_s;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = ~src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecTest(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s & src_s;
+        
+        FlagsZN(rt.state, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecPush(Runtime & rt, const InstructionDesc & desc, USHORT data) { // sp -= 2; mem[sp] = src
+        
+        USHORT * regs = rt.state.regs;
+        
+        if (regs[Runtime::SP] <= 16)
+            throw UnrecError("Stack overflow.");
+        regs[Runtime::SP] -= 2;
+        USHORT src_u;
+        if (!LoadUnsigned<SRC>(rt, desc.src_reg_no, data, src_u)) return false;
+        return rt.memStore(regs[Runtime::SP], src_u);
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecPop(Runtime & rt, const InstructionDesc & desc, USHORT data) { // dst = mem[sp]; sp += 2
+        
+        USHORT * regs = rt.state.regs;
+        
+        if (regs[Runtime::SP] >= Runtime::SP_INIT)
+            throw UnrecError("Stack underflow.");
+        USHORT dst_u;
+        if (!rt.memLoad(regs[Runtime::SP], dst_u)) return false;
+        if (!StoreUnsigned<DST>(rt, desc.dst_reg_no, data, dst_u)) return false;
+        regs[Runtime::SP] += 2;
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecCall(Runtime & rt, const InstructionDesc & desc, USHORT data) { // push pc; pc = src
+        
+        USHORT * regs = rt.state.regs;
+        
+        regs[Runtime::SP] -= 2;
+        if (!rt.memStore(regs[Runtime::SP], regs[Runtime::PC])) return false;
+        return LoadUnsigned<SRC>(rt, desc.src_reg_no, data, regs[Runtime::PC]);
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecIret(Runtime & rt, const InstructionDesc &, USHORT) { // pop psw; pop pc
+        
+        USHORT * regs = rt.state.regs;
+        
+        USHORT dst_u;
+        if (!rt.memLoad(regs[Runtime::SP], dst_u)) return false;
+        regs[Runtime::SP] += 2;
+        rt.state.setPSW(dst_u);
+        if (!rt.memLoad(regs[Runtime::SP], dst_u)) return false;
+        regs[Runtime::SP] += 2;
+        regs[Runtime::PC] = dst_u;
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecMov(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short src_s;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, src_s)) return false;
+        
+        FlagsZN(rt.state, src_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecShl(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s << src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        rt.state.lazyShift(ProcessorState::LF_SHL, dst_s, res_s);
+        
+        return true;
+        
+    }
+    
+    template <unsigned DST, unsigned SRC>
+    inline
+    bool ExecShr(Runtime & rt, const InstructionDesc & desc, USHORT data) {
+        
+        short dst_s, src_s;
+        if (!LoadSigned<DST>(rt, desc.dst_reg_no, data, dst_s)) return false;
+        if (!LoadSigned<SRC>(rt, desc.src_reg_no, data, src_s)) return false;
+        short res_s = dst_s >> src_s;
+        if (!StoreSigned<DST>(rt, desc.dst_reg_no, data, res_s)) return false;
+        
+        rt.state.lazyShift(ProcessorState::LF_SHR, dst_s, res_s);
+        
+        return true;
+        
+    }
+    
 }
 
 
 #endif /* VM87_FUNCRT_HPP */
-
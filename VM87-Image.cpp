@@ -0,0 +1,332 @@
+
+#include "VM87-Image.hpp"
+#include "VM87-Snapshot.hpp"
+#include "VM87-SymIndex.hpp"
+#include "Asem-SymTab.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define USHORT_RANGE 65536
+
+namespace vm87 {
+    
+    using namespace asem;
+    
+    static_assert(sizeof(ImageHeader)  == 56u, "ImageHeader must be packed.");
+    static_assert(sizeof(ImageSection) == 16u, "ImageSection must be packed.");
+    static_assert(sizeof(ImageSymbol)  == 12u, "ImageSymbol must be packed.");
+    static_assert(sizeof(ImageReloc)   == 12u, "ImageReloc must be packed.");
+    
+    // Does [off, off + cnt * elem) fit in a file of the given size?
+    static
+    bool InFile(std::uint64_t off, std::uint64_t cnt, std::uint64_t elem, std::uint64_t size) {
+        
+        return (off % 4u) == 0u && off + cnt * elem <= size;
+        
+    }
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    ProgramImage::ProgramImage()
+        : base(nullptr)
+        , size(0)
+        , hdr(nullptr)
+        , sec(nullptr)
+        , sym(nullptr)
+        , rel(nullptr)
+        , str(nullptr) {
+        
+    }
+    
+    ProgramImage::~ProgramImage() {
+        
+        close();
+        
+    }
+    
+    void ProgramImage::open(const char * path) {
+        
+        close();
+        
+        int fd = ::open(path, O_RDONLY);
+        
+        if (fd < 0)
+            throw LoadError(std::string{"Could not open image ["} + path + "] for reading.");
+            
+        struct stat st;
+        
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ImageHeader)) {
+            ::close(fd);
+            throw LoadError(std::string{"Image ["} + path + "] is too short.");
+        }
+        
+        void * addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        
+        ::close(fd);
+        
+        if (addr == MAP_FAILED)
+            throw LoadError(std::string{"Could not map image ["} + path + "].");
+            
+        base = static_cast<const unsigned char*>(addr);
+        size = size_t(st.st_size);
+        hdr  = reinterpret_cast<const ImageHeader*>(base);
+        
+        // Validate (bounds only - the contents were checked by the converter):
+        
+        const char * error = nullptr;
+        
+        if (std::memcmp(hdr->magic, IMAGE_MAGIC, 4) != 0)
+            error = "not a program image";
+        else if (hdr->version != IMAGE_VERSION)
+            error = "unsupported image version";
+        else if (hdr->sec_cnt > 4u)
+            error = "too many sections";
+        else if (!InFile(hdr->sec_off, hdr->sec_cnt, sizeof(ImageSection), size) ||
+                 !InFile(hdr->sym_off, hdr->sym_cnt, sizeof(ImageSymbol),  size) ||
+                 !InFile(hdr->rel_off, hdr->rel_cnt, sizeof(ImageReloc),   size) ||
+                 !InFile(hdr->str_off, hdr->str_size, 1u, size))
+            error = "table out of bounds";
+        else if (hdr->str_size == 0u || base[hdr->str_off + hdr->str_size - 1u] != '\0')
+            error = "bad string table";
+            
+        if (error == nullptr) {
+            
+            sec = reinterpret_cast<const ImageSection*>(base + hdr->sec_off);
+            sym = reinterpret_cast<const ImageSymbol* >(base + hdr->sym_off);
+            rel = reinterpret_cast<const ImageReloc*  >(base + hdr->rel_off);
+            str = reinterpret_cast<const char*        >(base + hdr->str_off);
+            
+            for (size_t i = 0; i < hdr->sec_cnt && error == nullptr; i += 1) {
+                
+                if (sec[i].section >= 4u)
+                    error = "bad section";
+                else if (sec[i].addr < Runtime::SP_INIT ||
+                         std::uint64_t(sec[i].addr) + sec[i].size >= USHORT_RANGE - 128u)
+                    error = "section exceeds memory boundaries";
+                else if (std::uint64_t(sec[i].data_off) + sec[i].size > size)
+                    error = "section data out of bounds";
+                    
+            }
+            
+            for (size_t i = 0; i < hdr->sym_cnt && error == nullptr; i += 1) {
+                
+                if (sym[i].name >= hdr->str_size)
+                    error = "bad symbol name";
+                    
+            }
+            
+            for (size_t i = 0; i < hdr->rel_cnt && error == nullptr; i += 1) {
+                
+                if (rel[i].symbol >= hdr->sym_cnt)
+                    error = "relocation refers to a missing symbol";
+                else if (rel[i].type == RelocType::Undefined || rel[i].type > RelocType::PCRel_16)
+                    error = "bad relocation type";
+                else if (std::uint64_t(rel[i].offset) + RelocWidth(RelocType::Enum(rel[i].type)) > USHORT_RANGE)
+                    error = "relocation out of bounds";
+                    
+            }
+            
+        }
+        
+        if (error != nullptr) {
+            close();
+            throw LoadError(std::string{"Image ["} + path + "]: " + error + ".");
+        }
+        
+    }
+    
+    void ProgramImage::close() {
+        
+        if (base != nullptr)
+            munmap(const_cast<unsigned char*>(base), size);
+            
+        base = nullptr;
+        size = 0;
+        hdr  = nullptr;
+        sec  = nullptr;
+        sym  = nullptr;
+        rel  = nullptr;
+        str  = nullptr;
+        
+    }
+    
+    bool ProgramImage::IsImage(const char * path) {
+        
+        char magic[4];
+        
+        int fd = ::open(path, O_RDONLY);
+        
+        if (fd < 0) return false;
+        
+        bool rv = (read(fd, magic, 4) == 4 && std::memcmp(magic, IMAGE_MAGIC, 4) == 0);
+        
+        ::close(fd);
+        
+        return rv;
+        
+    }
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    void WriteImage(const ELFHolder & eh, const Runtime & rt, const char * path) {
+        
+        Section::Enum sect[4];
+        size_t        pos[4];
+        size_t        len[4];
+        size_t        start_addr;
+        
+        size_t cnt = rt.locateSections(eh, sect, pos, len, &start_addr);
+        
+        std::vector<std::pair<std::string, SymbolTableEntry>> st_vec;
+        eh.symtab.toOrderedVector(st_vec);
+        
+        // Tables:
+        
+        std::vector<ImageSection> sections;
+        std::vector<ImageSymbol>  symbols;
+        std::vector<ImageReloc>   relocs;
+        std::string               strtab;
+        
+        for (const auto & pair : st_vec) {
+            
+            ImageSymbol is{};
+            
+            is.name    = std::uint32_t(strtab.size());
+            is.value   = pair.second.value;
+            is.section = std::int8_t(pair.second.section);
+            is.scope   = std::uint8_t(pair.second.scope);
+            is.defined = pair.second.defined ? 1u : 0u;
+            
+            strtab += pair.first;
+            strtab += '\0';
+            
+            symbols.push_back(is);
+            
+        }
+        
+        if (strtab.empty()) strtab += '\0';
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            for (const RelocRecord & rr : eh.relocations[sect[i]]) {
+                
+                if (rr.value >= symbols.size())
+                    throw LoadError("Relocation refers to a missing symbol.");
+                    
+                ImageReloc ir{};
+                
+                ir.offset  = std::uint32_t(rr.offset);
+                ir.symbol  = std::uint32_t(rr.value);
+                ir.type    = std::uint8_t(rr.type);
+                ir.section = std::uint8_t(sect[i]);
+                
+                relocs.push_back(ir);
+                
+            }
+            
+        }
+        
+        // Layout:
+        
+        ImageHeader hdr{};
+        
+        std::memcpy(hdr.magic, IMAGE_MAGIC, 4);
+        
+        hdr.version  = IMAGE_VERSION;
+        hdr.sec_cnt  = std::uint16_t(cnt);
+        hdr.sym_cnt  = std::uint32_t(symbols.size());
+        hdr.rel_cnt  = std::uint32_t(relocs.size());
+        hdr.sec_off  = sizeof(ImageHeader);
+        hdr.sym_off  = hdr.sec_off + std::uint32_t(cnt * sizeof(ImageSection));
+        hdr.rel_off  = hdr.sym_off + std::uint32_t(symbols.size() * sizeof(ImageSymbol));
+        hdr.str_off  = hdr.rel_off + std::uint32_t(relocs.size() * sizeof(ImageReloc));
+        hdr.str_size = std::uint32_t(strtab.size());
+        hdr.entry    = rt.state.regs[Runtime::PC];
+        
+        std::memcpy(hdr.ivt, &(rt.mem[0]), sizeof(hdr.ivt));
+        
+        std::uint32_t data_off = hdr.str_off + hdr.str_size;
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            ImageSection is{};
+            
+            is.section  = std::uint32_t(sect[i]);
+            is.addr     = std::uint32_t(pos[i]);
+            is.size     = std::uint32_t(len[i]);
+            is.data_off = data_off;
+            
+            data_off += is.size;
+            
+            sections.push_back(is);
+            
+        }
+        
+        // Write:
+        
+        std::ofstream file{path, std::ios::binary};
+        
+        if (!file.is_open())
+            throw UnrecError(std::string{"Could not open file ["} + path + "] for writing.");
+            
+        file.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        file.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(ImageSection));
+        file.write(reinterpret_cast<const char*>(symbols.data()),  symbols.size()  * sizeof(ImageSymbol));
+        file.write(reinterpret_cast<const char*>(relocs.data()),   relocs.size()   * sizeof(ImageReloc));
+        file.write(strtab.data(), strtab.size());
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            const std::vector<unsigned char> & data = eh.sections[sect[i]].data;
+            
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            
+        }
+        
+        if (!file)
+            throw UnrecError(std::string{"Could not write image ["} + path + "].");
+            
+    }
+    
+    void LoadProgram(Runtime & rt, const char * path, SymbolIndex * symbols) {
+        
+        if (IsSnapshot(path)) {
+            
+            RestoreSnapshot(rt, path);
+            
+            if (symbols != nullptr) symbols->clear();
+            
+        } else if (ProgramImage::IsImage(path)) {
+            
+            ProgramImage img{};
+            
+            img.open(path);
+            
+            rt.loadFromImage(img);
+            
+            if (symbols != nullptr) symbols->build(img, rt);
+            
+        } else {
+            
+            ELFHolder eh{};
+            
+            eh.loadFromFile(path);
+            
+            rt.loadFromELF(eh, /* cs */ true); // CS must be true!!!
+            
+            if (symbols != nullptr) symbols->build(eh.symtab, rt);
+            
+        }
+        
+    }
+    
+}
+
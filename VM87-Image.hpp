@@ -0,0 +1,133 @@
+
+#ifndef VM87_IMAGE_HPP
+#define VM87_IMAGE_HPP
+
+#include "VM87-Runtime.hpp"
+#include "Asem-ELFHolder.hpp"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace vm87 {
+    
+    // Binary program image (vm87 convert in.se out.img). Produced once from a
+    // textual .se file and then loaded by mapping the file into memory - all
+    // the symbol resolution, section placement and validation is done by the
+    // converter, so loading is a few memcpy calls plus the relocations.
+    //
+    // Layout (little-endian, all offsets from the start of the file):
+    //   ImageHeader
+    //   ImageSection  [sec_cnt]
+    //   ImageSymbol   [sym_cnt]  (by ordinal)
+    //   ImageReloc    [rel_cnt]  (grouped by section)
+    //   string table  [str_size] (NUL-terminated symbol names)
+    //   section bytes
+    
+    struct ImageHeader {
+        
+        char          magic[4];  // IMAGE_MAGIC
+        std::uint16_t version;   // IMAGE_VERSION
+        std::uint16_t sec_cnt;
+        std::uint32_t sym_cnt;
+        std::uint32_t rel_cnt;
+        std::uint32_t sec_off;
+        std::uint32_t sym_off;
+        std::uint32_t rel_off;
+        std::uint32_t str_off;
+        std::uint32_t str_size;
+        std::uint16_t entry;     // Initial PC (_start)
+        std::uint16_t ivt[8];    // Interrupt vector table (0 - not defined)
+        std::uint16_t reserved;
+        
+    };
+    
+    struct ImageSection {
+        
+        std::uint32_t section;   // asem::Section::Enum
+        std::uint32_t addr;      // Load address
+        std::uint32_t size;
+        std::uint32_t data_off;
+        
+    };
+    
+    struct ImageSymbol {
+        
+        std::uint32_t name;      // Offset in the string table
+        std::int32_t  value;
+        std::int8_t   section;   // asem::Section::Enum
+        std::uint8_t  scope;     // asem::Scope::Enum
+        std::uint8_t  defined;
+        std::uint8_t  reserved;
+        
+    };
+    
+    struct ImageReloc {
+        
+        std::uint32_t offset;    // Absolute address
+        std::uint32_t symbol;    // Ordinal
+        std::uint8_t  type;      // asem::RelocType::Enum
+        std::uint8_t  section;   // asem::Section::Enum
+        std::uint16_t reserved;
+        
+    };
+    
+    static const char          IMAGE_MAGIC[4] = {'V', '8', '7', 'I'};
+    static const std::uint16_t IMAGE_VERSION  = 1u;
+    
+    // A read-only view of an image file (mapped, not read).
+    class ProgramImage {
+    
+    public:
+        
+        ProgramImage();
+        
+        ~ProgramImage();
+        
+        ProgramImage(const ProgramImage &) = delete;
+        ProgramImage & operator=(const ProgramImage &) = delete;
+        
+        // Maps and validates the file (throws LoadError).
+        void open(const char * path);
+        
+        void close();
+        
+        // Does the file start with IMAGE_MAGIC?
+        static bool IsImage(const char * path);
+        
+        const ImageHeader  & header()   const { return *hdr; }
+        const ImageSection * sections() const { return sec; }
+        const ImageSymbol  * symbols()  const { return sym; }
+        const ImageReloc   * relocs()   const { return rel; }
+        
+        const char * symbolName(const ImageSymbol & s) const { return str + s.name; }
+        
+        const unsigned char * data(const ImageSection & s) const { return base + s.data_off; }
+        
+    private:
+        
+        const unsigned char * base;
+        size_t size;
+        
+        const ImageHeader  * hdr;
+        const ImageSection * sec;
+        const ImageSymbol  * sym;
+        const ImageReloc   * rel;
+        const char         * str;
+        
+    };
+    
+    // Writes the image of a program loaded into rt from eh (with loadFromELF)
+    // - the loaded state provides the section layout, entry point and IVT.
+    void WriteImage(const asem::ELFHolder & eh, const Runtime & rt, const char * path);
+    
+    class SymbolIndex;
+    
+    // Loads a snapshot, an image or a textual .se file (picked by contents).
+    // Also indexes the program's symbols by address if symbols is not null
+    // (snapshots have none - the index is left empty).
+    void LoadProgram(Runtime & rt, const char * path, SymbolIndex * symbols = nullptr);
+    
+}
+
+#endif /* VM87_IMAGE_HPP */
+
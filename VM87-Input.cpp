@@ -0,0 +1,112 @@
+
+#include "VM87-Input.hpp"
+
+#include <chrono>
+#include <poll.h>
+#include <unistd.h>
+
+namespace vm87 {
+    
+    static const int INPUT_POLL_MS = 50; // How often stop() is noticed
+    
+    InputThread::InputThread()
+        : head(0)
+        , tail(0)
+        , running(false)
+        , fd(0)
+        , tty(false)
+        { }
+        
+    InputThread::~InputThread() {
+        
+        stop();
+        
+    }
+    
+    void InputThread::start(int fd) {
+        
+        if (running.load()) return;
+        
+        this->fd  = fd;
+        this->tty = (::isatty(fd) != 0);
+        
+        running.store(true);
+        
+        thread = std::thread(&InputThread::run, this);
+        
+    }
+    
+    void InputThread::stop() {
+        
+        running.store(false);
+        
+        if (thread.joinable()) thread.join();
+        
+    }
+    
+    bool InputThread::push(int ch) {
+        
+        size_t h = head.load(std::memory_order_relaxed);
+        
+        if (h - tail.load(std::memory_order_acquire) == QUEUE_SIZE) return false; // Full
+        
+        queue[h & (QUEUE_SIZE - 1u)] = ch;
+        
+        head.store(h + 1u, std::memory_order_release);
+        
+        return true;
+        
+    }
+    
+    bool InputThread::pop(int & ch) {
+        
+        size_t t = tail.load(std::memory_order_relaxed);
+        
+        if (head.load(std::memory_order_acquire) == t) return false; // Empty
+        
+        ch = queue[t & (QUEUE_SIZE - 1u)];
+        
+        tail.store(t + 1u, std::memory_order_release);
+        
+        return true;
+        
+    }
+    
+    void InputThread::run() {
+        
+        while (running.load()) {
+            
+            pollfd pfd{fd, POLLIN, 0};
+            
+            int rv = ::poll(&pfd, 1, INPUT_POLL_MS);
+            
+            if (rv <= 0) continue;
+            
+            unsigned char buf[64];
+            
+            ssize_t cnt = ::read(fd, buf, sizeof(buf));
+            
+            if (cnt <= 0) break; // EOF or error
+            
+            for (ssize_t i = 0; i < cnt; i += 1) {
+                
+                // Same as getch() in nl() mode (the ncurses default):
+                int ch = (tty && buf[i] == '\r') ? '\n' : buf[i];
+                
+                // Never drop keys - wait for the consumer instead:
+                while (!push(ch)) {
+                    
+                    if (!running.load()) return;
+                    
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    
+                }
+                
+            }
+            
+        }
+        
+    }
+    
+}
+
@@ -0,0 +1,65 @@
+
+#ifndef VM87_INPUT_HPP
+#define VM87_INPUT_HPP
+
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+namespace vm87 {
+    
+    // Reads the terminal (stdin) on its own thread and queues keystrokes in a
+    // single-producer/single-consumer lock-free ring, so that the execution
+    // thread never waits for terminal I/O: it only checks pending() at its
+    // interrupt poll points and takes one key per INT_KEYSTROKE.
+    //
+    // Must not run while anything else (ncurses getch) reads the terminal.
+    // Files and pipes (headless mode) are read as they are.
+    class InputThread {
+    
+    public:
+        
+        static const size_t QUEUE_SIZE = 256u; // Power of 2
+        
+        InputThread();
+        
+        ~InputThread();
+        
+        InputThread(const InputThread &) = delete;
+        InputThread & operator=(const InputThread &) = delete;
+        
+        void start(int fd = 0);
+        
+        void stop();
+        
+        bool pending() const {
+            return head.load(std::memory_order_acquire) !=
+                   tail.load(std::memory_order_relaxed);
+        }
+        
+        bool pop(int & ch);
+        
+    private:
+        
+        // Producer and consumer indices on separate cache lines:
+        alignas(64) std::atomic<size_t> head; // Written by the input thread
+        alignas(64) std::atomic<size_t> tail; // Written by the execution thread
+        alignas(64) std::atomic<bool> running;
+        
+        int queue[QUEUE_SIZE];
+        
+        int  fd;
+        bool tty;
+        
+        std::thread thread;
+        
+        void run();
+        
+        bool push(int ch);
+        
+    };
+    
+}
+
+#endif /* VM87_INPUT_HPP */
+
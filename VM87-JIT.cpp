@@ -0,0 +1,1244 @@
+
+#include "VM87-JIT.hpp"
+#include "VM87-Runtime.hpp"
+#include "VM87-Decode.hpp"
+#include "Asem-Enumeration.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define VM87_JIT_X64 1
+#include <sys/mman.h>
+#endif
+
+using namespace asem;
+
+namespace vm87 {
+
+#ifdef VM87_JIT_X64
+
+namespace {
+    
+    // Host registers:
+    enum {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+        R8  = 8, R15 = 15
+    };
+    
+    // Guest r0-r6 live in r8d-r14d (zero-extended), the PSW in r15d.
+    // Scratch: eax (result), ebx (dst), ebp (src), ecx, edx.
+    // rdi = ProcessorState *, rsi = mem.
+    inline unsigned GuestReg(unsigned reg_no) { return R8 + reg_no; }
+    
+    const unsigned PSW = R15;
+    
+    // Condition codes:
+    enum {
+        CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6,
+        CC_A = 0x7, CC_S  = 0x8, CC_NS = 0x9, CC_LE = 0xE, CC_G = 0xF
+    };
+    
+    // Flags (same bits as in the PSW):
+    const unsigned F_Z = 1u, F_O = 2u, F_C = 4u, F_N = 8u;
+    const unsigned F_ALL = F_Z | F_O | F_C | F_N;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    struct Label {
+        
+        long pos = -1;
+        std::vector<size_t> fixups; // Positions of rel32 fields
+        
+    };
+    
+    // Minimal x86-64 assembler (only what the code generator needs).
+    class Emitter {
+    
+    public:
+        
+        std::vector<unsigned char> code;
+        
+        void byte(unsigned v) { code.push_back(static_cast<unsigned char>(v)); }
+        
+        void word(unsigned v) { byte(v); byte(v >> 8); }
+        
+        void dword(unsigned v) { word(v); word(v >> 16); }
+        
+        void rex(bool w, unsigned r, unsigned x, unsigned b) {
+            unsigned v = 0x40 | (w << 3) | ((r >> 3) << 2) | ((x >> 3) << 1) | (b >> 3);
+            if (v != 0x40) byte(v);
+        }
+        
+        void modrm(unsigned mod, unsigned reg, unsigned rm) {
+            byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+        }
+        
+        // op r/m32, r32 (e.g. add, sub, and, or, cmp, test, mov):
+        void rr(unsigned opc, unsigned rm, unsigned reg) {
+            rex(false, reg, 0, rm); byte(opc); modrm(3, reg, rm);
+        }
+        
+        // 0F op r32, r/m32 (imul, movzx, movsx):
+        void rr0f(unsigned opc, unsigned reg, unsigned rm) {
+            rex(false, reg, 0, rm); byte(0x0F); byte(opc); modrm(3, reg, rm);
+        }
+        
+        void mov(unsigned dst, unsigned src)   { rr(0x89, dst, src); }
+        void add(unsigned dst, unsigned src)   { rr(0x01, dst, src); }
+        void sub(unsigned dst, unsigned src)   { rr(0x29, dst, src); }
+        void and_(unsigned dst, unsigned src)  { rr(0x21, dst, src); }
+        void or_(unsigned dst, unsigned src)   { rr(0x09, dst, src); }
+        void test(unsigned dst, unsigned src)  { rr(0x85, dst, src); }
+        void imul(unsigned dst, unsigned src)  { rr0f(0xAF, dst, src); }
+        void movzx16(unsigned dst, unsigned src) { rr0f(0xB7, dst, src); }
+        void movsx16(unsigned dst, unsigned src) { rr0f(0xBF, dst, src); }
+        void movzx8(unsigned dst, unsigned src)  { rr0f(0xB6, dst, src); } // src < 4
+        
+        // Group 1 with an immediate (0 add, 1 or, 4 and, 5 sub, 7 cmp):
+        void alu(unsigned ext, unsigned rm, int imm) {
+            rex(false, 0, 0, rm);
+            if (imm >= -128 && imm <= 127) {
+                byte(0x83); modrm(3, ext, rm); byte(imm);
+            } else {
+                byte(0x81); modrm(3, ext, rm); dword(imm);
+            }
+        }
+        
+        void addi(unsigned rm, int imm) { alu(0, rm, imm); }
+        void ori (unsigned rm, int imm) { alu(1, rm, imm); }
+        void andi(unsigned rm, int imm) { alu(4, rm, imm); }
+        void subi(unsigned rm, int imm) { alu(5, rm, imm); }
+        void cmpi(unsigned rm, int imm) { alu(7, rm, imm); }
+        
+        void testi(unsigned rm, unsigned imm) {
+            rex(false, 0, 0, rm); byte(0xF7); modrm(3, 0, rm); dword(imm);
+        }
+        
+        void movi(unsigned dst, unsigned imm) {
+            rex(false, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(imm);
+        }
+        
+        void not_(unsigned rm) { rex(false, 0, 0, rm); byte(0xF7); modrm(3, 2, rm); }
+        
+        // Shifts (4 shl, 5 shr, 7 sar):
+        void shifti(unsigned ext, unsigned rm, unsigned n) {
+            rex(false, 0, 0, rm); byte(0xC1); modrm(3, ext, rm); byte(n);
+        }
+        
+        void shiftcl(unsigned ext, unsigned rm) {
+            rex(false, 0, 0, rm); byte(0xD3); modrm(3, ext, rm);
+        }
+        
+        void cdq() { byte(0x99); }
+        
+        void idiv(unsigned rm) { rex(false, 0, 0, rm); byte(0xF7); modrm(3, 7, rm); }
+        
+        void setcc(unsigned cc, unsigned r8) { byte(0x0F); byte(0x90 + cc); modrm(3, 0, r8); } // r8 < 4
+        
+        // movzx r32, word [base + disp8]:
+        void loadState(unsigned dst, unsigned disp) {
+            rex(false, dst, 0, RDI); byte(0x0F); byte(0xB7); modrm(1, dst, RDI); byte(disp);
+        }
+        
+        // mov word [base + disp8], r16:
+        void storeState(unsigned disp, unsigned src) {
+            byte(0x66); rex(false, src, 0, RDI); byte(0x89); modrm(1, src, RDI); byte(disp);
+        }
+        
+        // movsx r32, word [rsi + index]:
+        void loadMem(unsigned dst, unsigned index) {
+            rex(false, dst, index, RSI); byte(0x0F); byte(0xBF);
+            modrm(0, dst, 4); byte(((index & 7) << 3) | RSI);
+        }
+        
+        // mov word [rsi + index], r16:
+        void storeMem(unsigned index, unsigned src) {
+            byte(0x66); rex(false, src, index, RSI); byte(0x89);
+            modrm(0, src, 4); byte(((index & 7) << 3) | RSI);
+        }
+        
+        // movsx r32, word [rsi + disp32]:
+        void loadMemAbs(unsigned dst, unsigned addr) {
+            rex(false, dst, 0, RSI); byte(0x0F); byte(0xBF); modrm(2, dst, RSI); dword(addr);
+        }
+        
+        // mov word [rsi + disp32], r16:
+        void storeMemAbs(unsigned addr, unsigned src) {
+            byte(0x66); rex(false, src, 0, RSI); byte(0x89); modrm(2, src, RSI); dword(addr);
+        }
+        
+        void push(unsigned r) { rex(false, 0, 0, r); byte(0x50 + (r & 7)); }
+        void pop (unsigned r) { rex(false, 0, 0, r); byte(0x58 + (r & 7)); }
+        void ret() { byte(0xC3); }
+        
+        // Stop count (3rd argument, rdx) kept at [rsp]:
+        void saveStop() { byte(0x48); byte(0x89); byte(0x14); byte(0x24); }
+
+        // cmp r64, qword [rsp] (the stop count):
+        void cmpStop(unsigned r) { byte(0x48); byte(0x3B); modrm(0, r, RSP); byte(0x24); } // r < 8
+        
+        // mov r64, qword [rdi + disp8]:
+        void loadState64(unsigned dst, unsigned disp) {
+            rex(true, dst, 0, RDI); byte(0x8B); modrm(1, dst, RDI); byte(disp);
+        }
+        
+        // add r64, imm8:
+        void addi64(unsigned rm, int imm) {
+            rex(true, 0, 0, rm); byte(0x83); modrm(3, 0, rm); byte(imm);
+        }
+        
+        // mov r64, imm64:
+        void movi64(unsigned dst, std::uint64_t imm) {
+            rex(true, 0, 0, dst); byte(0xB8 + (dst & 7)); dword(unsigned(imm)); dword(unsigned(imm >> 32));
+        }
+        
+        // add qword [base + disp8], imm32 (base not rsp / rbp):
+        void addMem64(unsigned base, unsigned disp, int imm) {
+            rex(true, 0, 0, base); byte(0x81); modrm(1, 0, base); byte(disp); dword(unsigned(imm));
+        }
+        
+// add qword [rdi + disp8], imm32:
+        void addState64(unsigned disp, unsigned imm) {
+            byte(0x48); byte(0x81); modrm(1, 0, RDI); byte(disp); dword(imm);
+        }
+        
+        void allocFrame() { byte(0x48); byte(0x83); byte(0xEC); byte(0x08); }
+        void freeFrame()  { byte(0x48); byte(0x83); byte(0xC4); byte(0x08); }
+        
+        // Jumps (always rel32):
+        void jcc(unsigned cc, Label & l) { byte(0x0F); byte(0x80 + cc); ref(l); }
+        void jmp(Label & l) { byte(0xE9); ref(l); }
+        
+        void bind(Label & l) {
+            l.pos = long(code.size());
+            for (size_t f : l.fixups) patch(f, l.pos);
+            l.fixups.clear();
+        }
+        
+    private:
+        
+        void ref(Label & l) {
+            size_t at = code.size();
+            dword(0);
+            if (l.pos >= 0) patch(at, l.pos); else l.fixups.push_back(at);
+        }
+        
+        void patch(size_t at, long target) {
+            int rel = int(target - long(at + 4));
+            std::memcpy(&code[at], &rel, 4);
+        }
+        
+    };
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    struct Range {
+        
+        unsigned lo, hi; // [lo, hi)
+        
+    };
+    
+    typedef std::vector<Range> RangeList;
+    
+    void AddRange(RangeList & list, size_t lo, size_t len) {
+        
+        if (len == 0) return;
+        
+        list.push_back(Range{unsigned(lo), unsigned(lo + len)});
+        
+        // Keep sorted and merged (adjacent ranges become one):
+        for (size_t i = list.size() - 1; i > 0 && list[i].lo < list[i - 1].lo; i -= 1)
+            std::swap(list[i], list[i - 1]);
+            
+        RangeList merged;
+        
+        for (const Range & r : list) {
+            if (!merged.empty() && r.lo <= merged.back().hi) {
+                if (r.hi > merged.back().hi) merged.back().hi = r.hi;
+            } else {
+                merged.push_back(r);
+            }
+        }
+        
+        list.swap(merged);
+        
+    }
+    
+    // Word access (both bytes) allowed?
+    bool InRanges(const RangeList & list, unsigned addr) {
+        
+        for (const Range & r : list)
+            if (addr >= r.lo && addr + 1u < r.hi) return true;
+            
+        return false;
+        
+    }
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    struct JInstr {
+        
+        USHORT pc;
+        USHORT next_pc;
+        USHORT data;
+        const InstructionDesc * desc;
+        
+        unsigned flags_read;
+        unsigned flags_written;
+        unsigned flags_needed;
+        
+        bool may_exit;   // Exits before the instruction (or jumps)
+        bool writes_pc;
+        
+        unsigned loads;  // Memory words read / written (as counted by
+        unsigned stores; // Runtime::memLoad / memStore)
+        
+    };
+    
+    bool WritesDst(Command::Enum id) {
+        
+        switch (id) {
+            case Command::Cmp:
+            case Command::Test:
+            case Command::Push:
+            case Command::Call:
+            case Command::Iret:
+                return false;
+            default:
+                return true;
+        }
+        
+    }
+    
+    bool ReadsDst(Command::Enum id) {
+        
+        switch (id) {
+            case Command::Not:
+            case Command::Mov:
+            case Command::Push:
+            case Command::Pop:
+            case Command::Call:
+            case Command::Iret:
+                return false;
+            default:
+                return true;
+        }
+        
+    }
+    
+    bool ReadsSrc(Command::Enum id) {
+        
+        return (id != Command::Pop && id != Command::Iret);
+        
+    }
+    
+    unsigned FlagsWritten(Command::Enum id) {
+        
+        switch (id) {
+            case Command::Add:
+            case Command::Sub:
+            case Command::Cmp:
+                return F_ALL;
+            case Command::Shl:
+            case Command::Shr:
+                return F_Z | F_N | F_C;
+            case Command::Push:
+            case Command::Pop:
+            case Command::Call:
+            case Command::Iret:
+                return 0u;
+            default:
+                return F_Z | F_N;
+        }
+        
+    }
+    
+    bool IsPsw(AddrMode::Enum am, unsigned reg_no) {
+        
+        return (am == AddrMode::Imm && reg_no == Runtime::PC);
+        
+    }
+    
+    bool IsMem(AddrMode::Enum am) {
+        
+        return (am == AddrMode::MemDir || am == AddrMode::RegInd);
+        
+    }
+    
+    ////////////////////////////////////////////////////////////////////////////
+    
+    class CodeGen {
+    
+    public:
+        
+        CodeGen(const Runtime & rt, const RangeList & rd, const RangeList & wr)
+            : rt(rt), rd(rd), wr(wr) { }
+            
+        bool analyze(USHORT entry);
+        
+        void generate(std::vector<unsigned char> & out);
+        
+    private:
+        
+        const Runtime & rt;
+        const RangeList & rd;
+        const RangeList & wr;
+        
+        std::vector<JInstr> list;
+        
+        // Memory accesses of the first i instructions (counted on exits):
+        std::vector<unsigned> loads_before;
+        std::vector<unsigned> stores_before;
+        
+        USHORT entry_pc;
+        USHORT end_pc;
+        
+        unsigned regs_used;
+        unsigned regs_written;
+        
+        Emitter e;
+        
+        Label body;
+        Label writeback; // PC in eax
+        
+        bool supported(JInstr & ji);
+        
+        bool staticAddr(AddrMode::Enum am, unsigned reg_no, const JInstr & ji, unsigned & addr) const;
+        
+        void emitAddr(unsigned out, AddrMode::Enum am, unsigned reg_no, const JInstr & ji, bool sp_adjusted);
+        void emitCheck(unsigned addr_reg, const RangeList & list, Label & deopt);
+        void emitLoad(unsigned out, AddrMode::Enum am, unsigned reg_no, const JInstr & ji, bool sp_adjusted);
+        void emitStoreDst(const JInstr & ji);
+        void emitFlags(const JInstr & ji);
+        void emitOverflow(bool sub);
+        void emitCounts(int loads, int stores, int skipped);
+        void emitRetired(size_t n);
+        void emitExitStatic(USHORT pc, size_t retired);
+        void emitJump(size_t retired); // PC in eax
+        
+        void emitInstr(const JInstr & ji, size_t idx);
+        
+    };
+    
+    bool CodeGen::staticAddr
+        ( AddrMode::Enum am
+        , unsigned reg_no
+        , const JInstr & ji
+        , unsigned & addr
+        ) const {
+        
+        if (am == AddrMode::MemDir) {
+            addr = ji.data;
+            return true;
+        }
+        
+        if (am == AddrMode::RegInd && reg_no == Runtime::PC) {
+            addr = USHORT(ji.next_pc + ji.data);
+            return true;
+        }
+        
+        return false;
+        
+    }
+    
+    bool CodeGen::supported(JInstr & ji) {
+        
+        const InstructionDesc & d = *ji.desc;
+        
+        Command::Enum id = d.getId();
+        
+        if (id == Command::Iret) return false;
+        
+        bool rd_dst = ReadsDst(id);
+        bool wr_dst = WritesDst(id);
+        bool rd_src = ReadsSrc(id);
+        
+        // Writes to the PSW end the block (handled by the interpreter):
+        if (wr_dst && IsPsw(d.getDstAM(), d.dst_reg_no)) return false;
+        
+        // Static memory operands must be accessible (no I/O area either):
+        unsigned addr;
+        
+        if ((rd_dst || wr_dst) && staticAddr(d.getDstAM(), d.dst_reg_no, ji, addr)) {
+            if (rd_dst && !InRanges(rd, addr)) return false;
+            if (wr_dst && !InRanges(wr, addr)) return false;
+        }
+        
+        if (rd_src && staticAddr(d.getSrcAM(), d.src_reg_no, ji, addr)) {
+            if (!InRanges(rd, addr)) return false;
+        }
+        
+        bool src_const = (d.getSrcAM() == AddrMode::Imm && d.src_reg_no != Runtime::PC);
+        
+        short src_val = short(ji.data);
+        
+        if (id == Command::Div && src_const && src_val == 0) return false;
+        
+        if ((id == Command::Shl || id == Command::Shr) && src_const &&
+            (src_val < 0 || src_val > 31)) return false;
+            
+        // Flags:
+        switch (d.getPred()) {
+            case Predicate::Eq:
+            case Predicate::Ne:
+                ji.flags_read = F_Z;
+                break;
+            case Predicate::Gt:
+                ji.flags_read = F_Z | F_N;
+                break;
+            default:
+                ji.flags_read = 0u;
+                break;
+        }
+        
+        if ((rd_dst && IsPsw(d.getDstAM(), d.dst_reg_no)) ||
+            (rd_src && IsPsw(d.getSrcAM(), d.src_reg_no)))
+            ji.flags_read = F_ALL;
+            
+        ji.flags_written = FlagsWritten(id);
+        
+        ji.writes_pc = (id == Command::Call) ||
+                       (wr_dst && d.getDstAM() == AddrMode::RegDir &&
+                                  d.dst_reg_no == Runtime::PC);
+                                  
+        ji.loads  = ((rd_dst && IsMem(d.getDstAM())) ? 1u : 0u) +
+                    ((rd_src && IsMem(d.getSrcAM())) ? 1u : 0u) +
+                    ((id == Command::Pop) ? 1u : 0u);
+        ji.stores = ((wr_dst && IsMem(d.getDstAM())) ? 1u : 0u) +
+                    ((id == Command::Push || id == Command::Call) ? 1u : 0u);
+                    
+        ji.may_exit = ji.writes_pc ||
+                      id == Command::Push || id == Command::Pop ||
+                      (id == Command::Div && !src_const) ||
+                      ((id == Command::Shl || id == Command::Shr) && !src_const);
+                      
+        if ((rd_dst || wr_dst) && d.getDstAM() == AddrMode::RegInd &&
+            d.dst_reg_no != Runtime::PC)
+            ji.may_exit = true;
+            
+        if (rd_src && d.getSrcAM() == AddrMode::RegInd && d.src_reg_no != Runtime::PC)
+            ji.may_exit = true;
+            
+        // Registers:
+        if ((rd_dst || wr_dst) && d.dst_reg_no != Runtime::PC &&
+            (d.getDstAM() == AddrMode::RegDir || d.getDstAM() == AddrMode::RegInd))
+            regs_used |= (1u << d.dst_reg_no);
+            
+        if (wr_dst && d.getDstAM() == AddrMode::RegDir && d.dst_reg_no != Runtime::PC)
+            regs_written |= (1u << d.dst_reg_no);
+            
+        if (rd_src && d.src_reg_no != Runtime::PC &&
+            (d.getSrcAM() == AddrMode::RegDir || d.getSrcAM() == AddrMode::RegInd))
+            regs_used |= (1u << d.src_reg_no);
+            
+        if (id == Command::Push || id == Command::Pop || id == Command::Call) {
+            regs_used    |= (1u << Runtime::SP);
+            regs_written |= (1u << Runtime::SP);
+        }
+        
+        return true;
+        
+    }
+    
+    bool CodeGen::analyze(USHORT entry) {
+        
+        size_t text_addr = rt.sec_addr[Section::Text];
+        size_t text_len  = rt.sec_len [Section::Text];
+        
+        entry_pc     = entry;
+        regs_used    = 0u;
+        regs_written = 0u;
+        
+        USHORT pc = entry;
+        
+        while (list.size() < JitCompiler::MAX_BLOCK_LEN) {
+            
+            if (pc < text_addr || pc + 2u > text_addr + text_len) break;
+            
+            JInstr ji{};
+            
+            ji.pc   = pc;
+            ji.desc = &rt.decode[ USHORT(rt.mem[pc]) | USHORT(rt.mem[pc + 1u] << 8) ];
+            
+            ji.next_pc = USHORT(pc + 2u);
+            
+            if (ji.desc->has_data) {
+                
+                if (pc + 4u > text_addr + text_len) break;
+                
+                ji.data = USHORT(rt.mem[pc + 2u]) | USHORT(rt.mem[pc + 3u] << 8);
+                ji.next_pc += 2u;
+                
+            }
+            
+            unsigned saved_used    = regs_used;
+            unsigned saved_written = regs_written;
+            
+            if (!supported(ji)) {
+                regs_used    = saved_used;
+                regs_written = saved_written;
+                break;
+            }
+            
+            list.push_back(ji);
+            
+            pc = ji.next_pc;
+            
+            if (ji.writes_pc && ji.desc->getPred() == Predicate::Al) break;
+            
+        }
+        
+        end_pc = pc;
+        
+        if (list.empty()) return false;
+        
+        loads_before .assign(1u, 0u);
+        stores_before.assign(1u, 0u);
+        
+        for (const JInstr & ji : list) {
+            loads_before .push_back(loads_before .back() + ji.loads);
+            stores_before.push_back(stores_before.back() + ji.stores);
+        }
+        
+        // Flag liveness (everything is live on every exit):
+        unsigned live = F_ALL;
+        
+        for (size_t i = list.size(); i > 0; i -= 1) {
+            
+            JInstr & ji = list[i - 1];
+            
+            if (ji.writes_pc) live = F_ALL;
+            
+            ji.flags_needed = ji.flags_written & live;
+            
+            if (ji.desc->getPred() == Predicate::Al)
+                live &= ~ji.flags_written;
+                
+            live |= ji.flags_read;
+            
+            if (ji.may_exit) live = F_ALL;
+            
+        }
+        
+        return true;
+        
+    }
+    
+    // Address of a memory operand into 'out' (zero-extended).
+    void CodeGen::emitAddr
+        ( unsigned out
+        , AddrMode::Enum am
+        , unsigned reg_no
+        , const JInstr & ji
+        , bool sp_adjusted
+        ) {
+        
+        unsigned addr;
+        
+        if (staticAddr(am, reg_no, ji, addr)) {
+            e.movi(out, addr);
+            return;
+        }
+        
+        // RegInd:
+        e.mov(out, GuestReg(reg_no));
+        int off = int(ji.data);
+        if (sp_adjusted && reg_no == Runtime::SP) off -= 2;
+        if (off != 0) e.addi(out, off);
+        e.movzx16(out, out);
+        
+    }
+    
+    void CodeGen::emitCheck(unsigned addr_reg, const RangeList & list, Label & deopt) {
+        
+        Label ok;
+        
+        for (const Range & r : list) {
+            e.mov(RCX, addr_reg);
+            if (r.lo != 0) e.subi(RCX, int(r.lo));
+            e.cmpi(RCX, int(r.hi - r.lo - 1u));
+            e.jcc(CC_B, ok);
+        }
+        
+        e.jmp(deopt);
+        e.bind(ok);
+        
+    }
+    
+    // Operand value into 'out' (sign-extended).
+    void CodeGen::emitLoad
+        ( unsigned out
+        , AddrMode::Enum am
+        , unsigned reg_no
+        , const JInstr & ji
+        , bool sp_adjusted
+        ) {
+        
+        unsigned addr;
+        
+        switch (am) {
+            
+            case AddrMode::Imm:
+                if (reg_no == Runtime::PC)
+                    e.movsx16(out, PSW);
+                else
+                    e.movi(out, unsigned(int(short(ji.data))));
+                break;
+                
+            case AddrMode::RegDir:
+                if (reg_no == Runtime::PC)
+                    e.movi(out, unsigned(int(short(ji.next_pc))));
+                else
+                    e.movsx16(out, GuestReg(reg_no));
+                break;
+                
+            case AddrMode::MemDir:
+            case AddrMode::RegInd:
+                if (staticAddr(am, reg_no, ji, addr)) {
+                    e.loadMemAbs(out, addr);
+                } else {
+                    emitAddr(RDX, am, reg_no, ji, sp_adjusted);
+                    e.loadMem(out, RDX);
+                }
+                break;
+                
+        }
+        
+    }
+    
+    // Result (ax) into the destination operand (PC is handled by the caller).
+    void CodeGen::emitStoreDst(const JInstr & ji) {
+        
+        const InstructionDesc & d = *ji.desc;
+        
+        unsigned addr;
+        
+        switch (d.getDstAM()) {
+            
+            case AddrMode::Imm:
+                break; // Only the PSW is writable (not compiled)
+                
+            case AddrMode::RegDir:
+                if (d.dst_reg_no != Runtime::PC)
+                    e.movzx16(GuestReg(d.dst_reg_no), RAX);
+                break;
+                
+            case AddrMode::MemDir:
+            case AddrMode::RegInd:
+                if (staticAddr(d.getDstAM(), d.dst_reg_no, ji, addr)) {
+                    e.storeMemAbs(addr, RAX);
+                } else {
+                    emitAddr(RCX, d.getDstAM(), d.dst_reg_no, ji, false);
+                    e.storeMem(RCX, RAX);
+                }
+                break;
+                
+        }
+        
+    }
+    
+    // OF, with ebx = dst, ebp = src, edx = result (all sign-extended).
+    void CodeGen::emitOverflow(bool sub) {
+        
+        Label neg, set, done;
+        
+        e.andi(PSW, ~int(F_O));
+        e.test(RBX, RBX);
+        e.jcc(CC_S, neg);
+        e.jcc(CC_E, done);
+        
+        // dst > 0:
+        e.test(RBP, RBP);
+        e.jcc(sub ? CC_NS : CC_LE, done); // add: src > 0, sub: src < 0
+        e.test(RDX, RDX);
+        e.jcc(CC_NS, done);               // res < 0
+        e.jmp(set);
+        
+        // dst < 0:
+        e.bind(neg);
+        e.test(RBP, RBP);
+        e.jcc(sub ? CC_LE : CC_NS, done); // add: src < 0, sub: src > 0
+        e.test(RDX, RDX);
+        e.jcc(CC_LE, done);               // res > 0
+        
+        e.bind(set);
+        e.ori(PSW, int(F_O));
+        
+        e.bind(done);
+        
+    }
+    
+    // Flags, with eax = full (int) result, ebx = dst, ebp = src.
+    void CodeGen::emitFlags(const JInstr & ji) {
+        
+        unsigned need = ji.flags_needed;
+        
+        if (need == 0u) return;
+        
+        Command::Enum id = ji.desc->getId();
+        
+        e.movsx16(RDX, RAX);
+        
+        if (need & F_Z) {
+            e.test(RDX, RDX);
+            e.setcc(CC_E, RCX);
+            e.movzx8(RCX, RCX);
+            e.andi(PSW, ~int(F_Z));
+            e.or_(PSW, RCX);
+        }
+        
+        if (need & F_N) {
+            e.mov(RCX, RDX);
+            e.shifti(5, RCX, 28);
+            e.andi(RCX, int(F_N));
+            e.andi(PSW, ~int(F_N));
+            e.or_(PSW, RCX);
+        }
+        
+        if (need & F_C) {
+            switch (id) {
+                case Command::Shl: // dst bit 15
+                    e.mov(RCX, RBX);
+                    e.shifti(5, RCX, 13);
+                    e.andi(RCX, int(F_C));
+                    break;
+                case Command::Shr: // dst bit 0
+                    e.mov(RCX, RBX);
+                    e.andi(RCX, 1);
+                    e.shifti(4, RCX, 2);
+                    break;
+                default:           // bit 16 of the int result
+                    e.mov(RCX, RAX);
+                    e.shifti(5, RCX, 14);
+                    e.andi(RCX, int(F_C));
+                    break;
+            }
+            e.andi(PSW, ~int(F_C));
+            e.or_(PSW, RCX);
+        }
+        
+        if (need & F_O) {
+            emitOverflow(id != Command::Add);
+        }
+        
+    }
+    
+    // Adds to Runtime::counters (uses ecx):
+    void CodeGen::emitCounts(int loads, int stores, int skipped) {
+        
+        if (loads == 0 && stores == 0 && skipped == 0) return;
+        
+        e.movi64(RCX, reinterpret_cast<std::uintptr_t>(&rt.counters));
+        
+        if (loads   != 0) e.addMem64(RCX, unsigned(offsetof(PerfCounters, loads)),   loads);
+        if (stores  != 0) e.addMem64(RCX, unsigned(offsetof(PerfCounters, stores)),  stores);
+        if (skipped != 0) e.addMem64(RCX, unsigned(offsetof(PerfCounters, skipped)), skipped);
+        
+    }
+    
+    // Instructions retired (and their memory accesses) since (this iteration
+    // of) the block started:
+    void CodeGen::emitRetired(size_t n) {
+        
+        if (n != 0)
+            e.addState64(unsigned(offsetof(ProcessorState, icount)), unsigned(n));
+            
+        emitCounts(int(loads_before[n]), int(stores_before[n]), 0);
+        
+    }
+    
+    void CodeGen::emitExitStatic(USHORT pc, size_t retired) {
+        
+        emitRetired(retired);
+        
+        e.movi(RAX, pc);
+        e.jmp(writeback);
+        
+    }
+    
+    // Jump to the PC in eax (loops back, the body checks the stop count).
+    void CodeGen::emitJump(size_t retired) {
+        
+        emitRetired(retired);
+        
+        e.movzx16(RAX, RAX);
+        e.cmpi(RAX, int(entry_pc));
+        e.jcc(CC_E, body);
+        e.jmp(writeback);
+        
+    }
+    
+    void CodeGen::emitInstr(const JInstr & ji, size_t idx) {
+        
+        const InstructionDesc & d = *ji.desc;
+        
+        Command::Enum  id = d.getId();
+        AddrMode::Enum dam = d.getDstAM();
+        AddrMode::Enum sam = d.getSrcAM();
+        
+        Label skip, deopt, stub_done;
+        
+        // Predicate:
+        switch (d.getPred()) {
+            case Predicate::Eq:
+                e.testi(PSW, F_Z);
+                e.jcc(CC_E, skip);
+                break;
+            case Predicate::Ne:
+                e.testi(PSW, F_Z);
+                e.jcc(CC_NE, skip);
+                break;
+            case Predicate::Gt:
+                e.testi(PSW, F_Z | F_N);
+                e.jcc(CC_NE, skip);
+                break;
+            default:
+                break;
+        }
+        
+        bool dyn_dst = ((dam == AddrMode::RegInd && d.dst_reg_no != Runtime::PC));
+        bool dyn_src = ((sam == AddrMode::RegInd && d.src_reg_no != Runtime::PC));
+        
+        switch (id) {
+            
+            case Command::Push: { // sp -= 2; mem[sp] = src
+                
+                unsigned sp = GuestReg(Runtime::SP);
+                
+                e.cmpi(sp, 16);
+                e.jcc(CC_BE, deopt);                   // Stack overflow
+                e.mov(RAX, sp);
+                e.subi(RAX, 2);
+                e.movzx16(RAX, RAX);
+                emitCheck(RAX, wr, deopt);
+                if (dyn_src) {
+                    emitAddr(RAX, sam, d.src_reg_no, ji, true);
+                    emitCheck(RAX, rd, deopt);
+                }
+                
+                e.subi(sp, 2);
+                e.movzx16(sp, sp);
+                emitLoad(RBP, sam, d.src_reg_no, ji, false);
+                e.storeMem(sp, RBP);
+                
+            }
+                break;
+                
+            case Command::Pop: { // dst = mem[sp]; sp += 2
+                
+                unsigned sp = GuestReg(Runtime::SP);
+                
+                e.cmpi(sp, Runtime::SP_INIT);
+                e.jcc(CC_AE, deopt);                   // Stack underflow
+                emitCheck(sp, rd, deopt);
+                if (dyn_dst) {
+                    emitAddr(RAX, dam, d.dst_reg_no, ji, false);
+                    emitCheck(RAX, wr, deopt);
+                }
+                
+                e.loadMem(RAX, sp);
+                emitStoreDst(ji);
+                e.addi(sp, 2);
+                e.movzx16(sp, sp);
+                
+                if (ji.writes_pc) emitJump(idx + 1);
+                
+            }
+                break;
+                
+            case Command::Call: { // push pc; pc = src
+                
+                unsigned sp = GuestReg(Runtime::SP);
+                
+                e.mov(RAX, sp);
+                e.subi(RAX, 2);
+                e.movzx16(RAX, RAX);
+                emitCheck(RAX, wr, deopt);
+                if (dyn_src) {
+                    emitAddr(RAX, sam, d.src_reg_no, ji, true);
+                    emitCheck(RAX, rd, deopt);
+                }
+                
+                e.subi(sp, 2);
+                e.movzx16(sp, sp);
+                e.movi(RAX, ji.next_pc);
+                e.storeMem(sp, RAX);
+                emitLoad(RAX, sam, d.src_reg_no, ji, false);
+                emitJump(idx + 1);
+                
+            }
+                break;
+                
+            default: {
+                
+                bool rd_dst = ReadsDst(id);
+                bool wr_dst = WritesDst(id);
+                
+                // Checks (before any side effect):
+                if (dyn_dst) {
+                    emitAddr(RAX, dam, d.dst_reg_no, ji, false);
+                    if (rd_dst) emitCheck(RAX, rd, deopt);
+                    if (wr_dst) emitCheck(RAX, wr, deopt);
+                }
+                
+                if (dyn_src) {
+                    emitAddr(RAX, sam, d.src_reg_no, ji, false);
+                    emitCheck(RAX, rd, deopt);
+                }
+                
+                // Operands:
+                if (rd_dst) emitLoad(RBX, dam, d.dst_reg_no, ji, false);
+                emitLoad(RBP, sam, d.src_reg_no, ji, false);
+                
+                // Operation (int result in eax):
+                switch (id) {
+                    
+                    case Command::Add:
+                        e.mov(RAX, RBX); e.add(RAX, RBP);
+                        break;
+                        
+                    case Command::Sub:
+                    case Command::Cmp:
+                        e.mov(RAX, RBX); e.sub(RAX, RBP);
+                        break;
+                        
+                    case Command::Mul:
+                        e.mov(RAX, RBX); e.imul(RAX, RBP);
+                        break;
+                        
+                    case Command::Div:
+                        e.test(RBP, RBP);
+                        e.jcc(CC_E, deopt);            // Division by zero
+                        e.mov(RAX, RBX); e.cdq(); e.idiv(RBP);
+                        break;
+                        
+                    case Command::And:
+                    case Command::Test:
+                        e.mov(RAX, RBX); e.and_(RAX, RBP);
+                        break;
+                        
+                    case Command::Or:
+                        e.mov(RAX, RBX); e.or_(RAX, RBP);
+                        break;
+                        
+                    case Command::Not:
+                        e.mov(RAX, RBP); e.not_(RAX);
+                        break;
+                        
+                    case Command::Mov:
+                        e.mov(RAX, RBP);
+                        break;
+                        
+                    case Command::Shl:
+                    case Command::Shr:
+                        e.cmpi(RBP, 31);
+                        e.jcc(CC_A, deopt);            // Out of range count
+                        e.mov(RCX, RBP);
+                        e.mov(RAX, RBX);
+                        e.shiftcl((id == Command::Shl) ? 4 : 7, RAX);
+                        break;
+                        
+                    default:
+                        break;
+                        
+                }
+                
+                if (wr_dst) emitStoreDst(ji);
+                
+                emitFlags(ji);
+                
+                if (ji.writes_pc) emitJump(idx + 1);
+                
+            }
+                break;
+                
+        }
+        
+        bool has_skip  = !skip.fixups.empty();
+        bool has_deopt = !deopt.fixups.empty();
+        
+        if (has_skip || has_deopt) e.jmp(stub_done);
+        
+        // Skip stub (out of line): counted as skipped, and without its memory
+        // accesses (an exit counts those of every instruction before it).
+        if (has_skip) {
+            e.bind(skip);
+            emitCounts(-int(ji.loads), -int(ji.stores), 1);
+            e.jmp(stub_done);
+        }
+        
+        // Deopt stub (out of line): leave the instruction to the interpreter.
+        if (has_deopt) {
+            e.bind(deopt);
+            emitExitStatic(ji.pc, idx);
+        }
+        
+        if (has_skip || has_deopt) e.bind(stub_done);
+        
+    }
+    
+    void CodeGen::generate(std::vector<unsigned char> & out) {
+        
+        static const unsigned SAVED[6] = { RBX, RBP, 12, 13, 14, R15 };
+        
+        // Prologue:
+        for (unsigned r : SAVED) e.push(r);
+        e.allocFrame();
+        e.saveStop();
+        
+        // (written registers too - the write may be skipped or deopted)
+        for (unsigned i = 0; i < 7; i += 1)
+            if ((regs_used | regs_written) & (1u << i))
+                e.loadState(GuestReg(i), unsigned(offsetof(ProcessorState, regs) + 2u * i));
+                
+        e.loadState(PSW, unsigned(offsetof(ProcessorState, psw)));
+        
+        // Body (not started if it could run past the stop count, so that the
+        // interpreter reaches the next event on the exact instruction):
+        Label stop;
+        
+        e.bind(body);
+        
+        e.loadState64(RCX, unsigned(offsetof(ProcessorState, icount)));
+        e.addi64(RCX, int(list.size()));
+        e.cmpStop(RCX);
+        e.jcc(CC_A, stop);
+        
+        for (size_t i = 0; i < list.size(); i += 1) emitInstr(list[i], i);
+        
+        emitExitStatic(end_pc, list.size());
+        
+        e.bind(stop);
+        emitExitStatic(entry_pc, 0);
+        
+        // Write back (PC in eax) and epilogue:
+        e.bind(writeback);
+        
+        for (unsigned i = 0; i < 7; i += 1)
+            if (regs_written & (1u << i))
+                e.storeState(unsigned(offsetof(ProcessorState, regs) + 2u * i), GuestReg(i));
+                
+        e.storeState(unsigned(offsetof(ProcessorState, psw)), PSW);
+        e.storeState(unsigned(offsetof(ProcessorState, regs) + 2u * Runtime::PC), RAX);
+        
+        e.freeFrame();
+        for (size_t i = 6; i > 0; i -= 1) e.pop(SAVED[i - 1]);
+        e.ret();
+        
+        out.swap(e.code);
+        
+    }
+    
+}
+
+#endif /* VM87_JIT_X64 */
+
+    ////////////////////////////////////////////////////////////////////////////
+    
+    static const size_t JIT_CHUNK_SIZE = 1u << 20;
+    
+    JitCompiler::JitCompiler(const Runtime & rt)
+        : rt(rt)
+        , block_cnt(0)
+        , code_size(0)
+        { }
+        
+    JitCompiler::~JitCompiler() {
+
+#ifdef VM87_JIT_X64
+        for (Chunk & c : chunks)
+            munmap(c.base, c.size);
+#endif
+
+    }
+    
+    bool JitCompiler::Supported() {
+
+#ifdef VM87_JIT_X64
+        return true;
+#else
+        return false;
+#endif
+
+    }
+    
+    void * JitCompiler::install(const std::vector<unsigned char> & code) {
+
+#ifdef VM87_JIT_X64
+        if (code.size() > JIT_CHUNK_SIZE) return nullptr;
+        
+        if (chunks.empty() || chunks.back().used + code.size() > chunks.back().size) {
+            
+            void * mem = mmap(nullptr, JIT_CHUNK_SIZE, PROT_READ | PROT_EXEC,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                              
+            if (mem == MAP_FAILED) return nullptr;
+            
+            chunks.push_back(Chunk{static_cast<unsigned char*>(mem), JIT_CHUNK_SIZE, 0});
+            
+        }
+        
+        Chunk & c = chunks.back();
+        
+        // W^X: writable only while the code is being copied in.
+        if (mprotect(c.base, c.size, PROT_READ | PROT_WRITE) != 0) return nullptr;
+        
+        unsigned char * dst = c.base + c.used;
+        
+        std::memcpy(dst, &code[0], code.size());
+        
+        c.used += (code.size() + 15u) & ~size_t(15u);
+        
+        if (mprotect(c.base, c.size, PROT_READ | PROT_EXEC) != 0)
+            throw UnrecError("vm87::JitCompiler::install(...) - mprotect failed.");
+            
+        return dst;
+#else
+        (void)code;
+        return nullptr;
+#endif
+
+    }
+    
+    JitCompiler::BlockFunc JitCompiler::compile(USHORT pc) {
+
+#ifdef VM87_JIT_X64
+        // Accessible memory (the I/O area is always left to the interpreter):
+        RangeList rd, wr;
+        
+        AddRange(rd, 0u, Runtime::SP_INIT);
+        AddRange(wr, 0u, Runtime::SP_INIT);
+        
+        for (size_t i = 0; i < 4; i += 1)
+            AddRange(rd, rt.sec_addr[i], rt.sec_len[i]);
+            
+        AddRange(wr, rt.sec_addr[Section::Data], rt.sec_len[Section::Data]);
+        AddRange(wr, rt.sec_addr[Section::BSS],  rt.sec_len[Section::BSS]);
+        
+        CodeGen cg{rt, rd, wr};
+        
+        if (!cg.analyze(pc)) return nullptr;
+        
+        std::vector<unsigned char> code;
+        
+        cg.generate(code);
+        
+        void * fn = install(code);
+        
+        if (fn == nullptr) return nullptr;
+        
+        block_cnt += 1;
+        code_size += code.size();
+        
+        return reinterpret_cast<BlockFunc>(fn);
+#else
+        (void)pc;
+        return nullptr;
+#endif
+
+    }
+    
+}
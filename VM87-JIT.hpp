@@ -0,0 +1,78 @@
+
+#ifndef VM87_JIT_HPP
+#define VM87_JIT_HPP
+
+#include "VM87-Runtime.hpp"
+
+#include <vector>
+
+namespace vm87 {
+    
+    // Compiles hot basic blocks of a loaded program to native x86-64 code
+    // (used by the ThreadedEngine as its second tier).
+    //
+    // Guest registers r0-r6 and the PSW live in host registers while a block
+    // runs and memory is accessed directly through a base pointer into
+    // Runtime::mem. Compiled code never raises errors itself: whenever an
+    // instruction might fault (access violation, division by zero, stack
+    // over/underflow...) or touches the I/O area, the block exits *before*
+    // that instruction, so the interpreter executes it with the usual
+    // Runtime::fault / INT_VIOLATION semantics.
+    class JitCompiler {
+    
+    public:
+        
+        // Runs the block and stores all state (including PC) back on exit.
+        // A block that loops back to itself keeps going until state->icount
+        // reaches stop (the next interrupt poll / timer event); an iteration
+        // that could run past stop isn't started at all (not even the first
+        // one, in which case the block returns without progress).
+        typedef void (*BlockFunc)
+            ( ProcessorState * state
+            , unsigned char * mem
+            , unsigned long long stop
+            ) ;
+        
+        static const unsigned MAX_BLOCK_LEN = 64u; // Instructions
+        
+        explicit JitCompiler(const Runtime & rt);
+        
+        ~JitCompiler();
+        
+        JitCompiler(const JitCompiler &) = delete;
+        JitCompiler & operator=(const JitCompiler &) = delete;
+        
+        // Is native code generation available on this host?
+        static bool Supported();
+        
+        // Returns nullptr if not even the first instruction can be compiled.
+        BlockFunc compile(USHORT pc);
+        
+        size_t blockCount() const { return block_cnt; }
+        size_t codeSize()   const { return code_size; }
+        
+    private:
+        
+        struct Chunk {
+            
+            unsigned char * base;
+            size_t size;
+            size_t used;
+            
+        };
+        
+        const Runtime & rt;
+        
+        std::vector<Chunk> chunks;
+        
+        size_t block_cnt;
+        size_t code_size;
+        
+        void * install(const std::vector<unsigned char> & code);
+        
+    };
+    
+}
+
+#endif /* VM87_JIT_HPP */
+
@@ -0,0 +1,35 @@
+
+#include "VM87-Mmio.hpp"
+
+#include <stdexcept>
+
+namespace vm87 {
+    
+    const unsigned MmioRegistry::BASE;
+    const unsigned MmioRegistry::SIZE;
+    
+    MmioRegistry::MmioRegistry() {
+        
+        for (size_t i = 0; i < SIZE; i += 1)
+            owner[i] = 0;
+            
+    }
+    
+    void MmioRegistry::attach(const MmioDevice & dev) {
+        
+        if (dev.len == 0 || dev.addr < BASE || size_t(dev.addr) + dev.len > BASE + SIZE)
+            throw std::invalid_argument("vm87::MmioRegistry::attach(...) - Range outside of the I/O area.");
+            
+        for (size_t i = dev.addr; i < size_t(dev.addr) + dev.len; i += 1)
+            if (owner[i - BASE] != 0)
+                throw std::invalid_argument("vm87::MmioRegistry::attach(...) - Range already taken.");
+                
+        devices.push_back(dev);
+        
+        for (size_t i = dev.addr; i < size_t(dev.addr) + dev.len; i += 1)
+            owner[i - BASE] = static_cast<unsigned char>(devices.size());
+            
+    }
+    
+}
+
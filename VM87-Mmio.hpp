@@ -0,0 +1,76 @@
+
+#ifndef VM87_MMIO_HPP
+#define VM87_MMIO_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace vm87 {
+    
+    class Runtime;
+    
+    // Memory-mapped I/O devices on the top 128 bytes of memory (see
+    // Runtime::devices). A device owns an address range and may hook reads
+    // and writes of it with callbacks; the permission map marks only the
+    // hooked bytes (PERM_IO_R / PERM_IO_W), so memLoad and memStore take the
+    // slow path for them alone and plain memory never pays for I/O checks.
+    //
+    // A word access is routed to the device owning its first byte, or to the
+    // one owning its second byte if the first isn't hooked. Callbacks run
+    // after the usual permission check (perm - rights of the range) and are
+    // given the accessed address; a write callback runs after the word
+    // has been stored to memory, which keeps the last value readable. They
+    // return false on a fault (see Runtime::setFault).
+    struct MmioDevice {
+        
+        typedef bool (*ReadFn) (Runtime & rt, void * user, unsigned short address, unsigned short & value);
+        typedef bool (*WriteFn)(Runtime & rt, void * user, unsigned short address, unsigned short value);
+        
+        const char *   name;
+        unsigned short addr;
+        unsigned short len;
+        unsigned char  perm;  // Runtime::PERM_R / PERM_W
+        ReadFn         read;  // nullptr - plain memory
+        WriteFn        write; // nullptr - plain memory
+        void *         user;  // (Passed to the callbacks)
+        
+    };
+    
+    class MmioRegistry {
+    
+    public:
+        
+        static const unsigned BASE = 65536u - 128u;
+        static const unsigned SIZE = 128u;
+        
+        MmioRegistry();
+        
+        // Throws std::invalid_argument for a range outside of the I/O area or
+        // overlapping another device:
+        void attach(const MmioDevice & dev);
+        
+        // Device owning the byte (nullptr - none):
+        const MmioDevice * find(unsigned short address) const {
+            
+            if (address < BASE || owner[address - BASE] == 0) return nullptr;
+            
+            return &devices[owner[address - BASE] - 1u];
+            
+        }
+        
+        size_t size() const { return devices.size(); }
+        
+        const MmioDevice & at(size_t i) const { return devices.at(i); }
+        
+    private:
+        
+        std::vector<MmioDevice> devices;
+        
+        unsigned char owner[SIZE]; // Device index + 1 per byte (0 - none)
+        
+    };
+    
+}
+
+#endif /* VM87_MMIO_HPP */
+
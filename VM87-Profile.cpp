@@ -0,0 +1,146 @@
+
+#include "VM87-Profile.hpp"
+#include "VM87-SymIndex.hpp"
+
+#include <algorithm>
+#include <string>
+#include <cstdio>
+
+namespace vm87 {
+    
+    Profile::Profile() {
+        
+        clear();
+        
+    }
+    
+    void Profile::clear() {
+        
+        pcs.assign(ENTRIES, ProfileCounters{0, 0, 0});
+        
+    }
+    
+    static
+    double Percent(unsigned long long part, unsigned long long whole) {
+        
+        return (whole == 0) ? 0.0 : (100.0 * double(part) / double(whole));
+        
+    }
+    
+    static
+    void WriteRow
+        ( std::ostream & os
+        , const char * head
+        , const ProfileCounters & c
+        , unsigned long long total
+        , const std::string & name
+        ) {
+        
+        char buffer[128];
+        
+        std::snprintf(buffer, sizeof(buffer), "%-8s %12llu %6.2f%% %10llu %10llu   "
+                     , head, c.retired, Percent(c.retired, total), c.taken, c.skipped);
+                     
+        os << buffer << name << "\n";
+        
+    }
+    
+    void WriteProfileReport
+        ( std::ostream & os
+        , const Profile & profile
+        , const SymbolIndex & symbols
+        , size_t top_n
+        ) {
+        
+        const ProfileCounters * pcs = profile.pcs.data();
+        
+        ProfileCounters total{0, 0, 0};
+        
+        std::vector<unsigned> hot; // Addresses that retired anything
+        
+        for (size_t pc = 0; pc < Profile::ENTRIES; pc += 1) {
+            
+            if (pcs[pc].retired == 0) continue;
+            
+            total.retired += pcs[pc].retired;
+            total.taken   += pcs[pc].taken;
+            total.skipped += pcs[pc].skipped;
+            
+            hot.push_back(unsigned(pc));
+            
+        }
+        
+        os << "# vm87 profile: " << total.retired << " instructions retired, "
+           << (total.taken + total.skipped) << " predicated ("
+           << total.taken << " taken, " << total.skipped << " skipped)\n";
+           
+        // Addresses: //////////////////////////////////////////////////////////
+        
+        size_t cnt = std::min(top_n, hot.size());
+        
+        std::partial_sort(hot.begin(), hot.begin() + cnt, hot.end(), [pcs](unsigned a, unsigned b) {
+            if (pcs[a].retired != pcs[b].retired) return pcs[a].retired > pcs[b].retired;
+            return a < b;
+        });
+        
+        os << "\n# Top " << cnt << " addresses:\n";
+        os << "#Address      Retired        %      Taken    Skipped   Symbol\n";
+        
+        char head[16];
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            std::snprintf(head, sizeof(head), "0x%04X", hot[i]);
+            
+            WriteRow(os, head, pcs[hot[i]], total.retired, symbols.describe(hot[i]));
+            
+        }
+        
+        // Functions (symbol intervals): ///////////////////////////////////////
+        
+        std::vector<ProfileCounters> funcs(symbols.size() + 1u, ProfileCounters{0, 0, 0});
+        
+        ProfileCounters & unknown = funcs.back(); // (Not covered by a symbol)
+        
+        unknown = total;
+        
+        for (size_t i = 0; i < symbols.size(); i += 1) {
+            
+            const SymbolIndex::Interval & iv = symbols.at(i);
+            
+            for (size_t pc = iv.start; pc < iv.end && pc < Profile::ENTRIES; pc += 1) {
+                funcs[i].retired += pcs[pc].retired;
+                funcs[i].taken   += pcs[pc].taken;
+                funcs[i].skipped += pcs[pc].skipped;
+            }
+            
+            unknown.retired -= funcs[i].retired;
+            unknown.taken   -= funcs[i].taken;
+            unknown.skipped -= funcs[i].skipped;
+            
+        }
+        
+        std::vector<size_t> order;
+        
+        for (size_t i = 0; i < funcs.size(); i += 1)
+            if (funcs[i].retired != 0) order.push_back(i);
+            
+        std::stable_sort(order.begin(), order.end(), [&funcs](size_t a, size_t b) {
+            return funcs[a].retired > funcs[b].retired;
+        });
+        
+        os << "\n# Functions:\n";
+        os << "#             Retired        %      Taken    Skipped   Symbol\n";
+        
+        for (size_t i : order) {
+            
+            std::string name = (i < symbols.size()) ? symbols.name(symbols.at(i)) : "<unknown>";
+            
+            WriteRow(os, "", funcs[i], total.retired, name);
+            
+        }
+        
+    }
+    
+}
+
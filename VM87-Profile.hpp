@@ -0,0 +1,48 @@
+
+#ifndef VM87_PROFILE_HPP
+#define VM87_PROFILE_HPP
+
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+namespace vm87 {
+    
+    class SymbolIndex;
+    
+    // Per-PC execution profile (see Runtime::profile). One entry per
+    // address, indexed by the PC an instruction was fetched from, so
+    // counting is a single array update per instruction.
+    struct ProfileCounters {
+        
+        unsigned long long retired; // Instructions retired (skipped ones too)
+        unsigned long long taken;   // Conditional, predicate held
+        unsigned long long skipped; // Conditional, predicate failed
+        
+    };
+    
+    struct Profile {
+        
+        static const size_t ENTRIES = 65536u;
+        
+        std::vector<ProfileCounters> pcs; // [ENTRIES]
+        
+        Profile();
+        
+        void clear();
+        
+    };
+    
+    // Totals, the top_n hottest addresses and totals per symbol (function),
+    // both with symbol names from symbols (may be empty).
+    void WriteProfileReport
+        ( std::ostream & os
+        , const Profile & profile
+        , const SymbolIndex & symbols
+        , size_t top_n
+        ) ;
+        
+}
+
+#endif /* VM87_PROFILE_HPP */
+
@@ -1,14 +1,19 @@
 
 #include "VM87-Runtime.hpp"
+#include "VM87-FuncRT.hpp"
+#include "VM87-Input.hpp"
+#include "VM87-Image.hpp"
+#include "VM87-Profile.hpp"
+#include "VM87-CallGraph.hpp"
 #include "Asem-Enumeration.hpp"
 #include "Asem-ELFHolder.hpp"
 #include "Asem-SymTab.hpp"
 #include "Asem-Func.hpp"
 #include "Punning.hpp"
-#include "CPrint.hpp"
 
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include <chrono>
 #include <curses.h>
 
@@ -16,30 +21,70 @@
 
 using namespace asem;
 
-static bool InRange(unsigned val, unsigned min, unsigned len) {
-        
-    return (val >= min && val < (min + len));
-
-}
-
 namespace vm87 {
     
-    InstructionDesc::InstructionDesc(unsigned short e) {
+#define EXEC_AM(func, dst) func<dst, 0>, func<dst, 1>, func<dst, 2>, func<dst, 3>
+#define EXEC_OP(func) EXEC_AM(func, 0), EXEC_AM(func, 1), EXEC_AM(func, 2), EXEC_AM(func, 3)
+    
+    // Indexed by ExecHandlerIndex (opcode, dst_am, src_am):
+    const ExecHandler EXEC_HANDLERS[EXEC_HANDLER_COUNT] = 
+        { EXEC_OP(ExecAdd),  EXEC_OP(ExecSub),  EXEC_OP(ExecMul),  EXEC_OP(ExecDiv)
+        , EXEC_OP(ExecCmp),  EXEC_OP(ExecAnd),  EXEC_OP(ExecOr),   EXEC_OP(ExecNot)
+        , EXEC_OP(ExecTest), EXEC_OP(ExecPush), EXEC_OP(ExecPop),  EXEC_OP(ExecCall)
+        , EXEC_OP(ExecIret), EXEC_OP(ExecMov),  EXEC_OP(ExecShl),  EXEC_OP(ExecShr)
+        } ;
+    
+#undef EXEC_OP
+#undef EXEC_AM
+    
+    // Built-in devices (see Runtime::devices):
+    
+    static bool IcountRead(Runtime & rt, void *, USHORT address, USHORT & value) {
         
-        pred = static_cast<Predicate::Enum>((e >> 14) & 0x3);
-        id   = static_cast<Command::Enum>(((e >> 10) & 0xF) + Command::Add);
+        // Latch the instruction counter (also for a word reaching into it):
+        if (address == Runtime::IO_ICOUNT || address + 1u == Runtime::IO_ICOUNT) {
+            unsigned long long icount = rt.state.icount;
+            for (size_t i = 0; i < 8; i += 1)
+                rt.mem[Runtime::IO_ICOUNT + i] = static_cast<unsigned char>(icount >> (8 * i));
+        }
         
-        dst_am = static_cast<AddrMode::Enum>((e >> 8) & 0x3);
-        src_am = static_cast<AddrMode::Enum>((e >> 3) & 0x3);
+        std::memcpy(&value, &rt.mem[address], sizeof(USHORT));
         
-        dst_reg_no = (e >> 5) & 0x7;
-        src_reg_no = (e >> 0) & 0x7;
+        return true;
         
     }
     
-    InstructionDesc::InstructionDesc()
-        : InstructionDesc(0u)
-        { }
+    static bool KeyboardRead(Runtime & rt, void *, USHORT address, USHORT & value) {
+        
+        // Latch the last key delivered (also for a word reaching into it):
+        std::memcpy(&rt.mem[Runtime::IO_KEYBOARD], &rt.key_latch, sizeof(USHORT));
+        
+        std::memcpy(&value, &rt.mem[address], sizeof(USHORT));
+        
+        return true;
+        
+    }
+    
+    static bool ConsoleWrite(Runtime & rt, void *, USHORT address, USHORT value) {
+        
+        if (address != Runtime::IO_CONSOLE) return true;
+        
+        char c;
+        
+        if (value == 10)
+            c = '\n';
+        else
+            c = static_cast<char>(value);
+        
+        if (c == '\0') return true; // (Never printed anything)
+        
+        rt.counters.console_bytes += 1;
+        
+        rt.console.put(c); // (FLUSH_DEBUG when debugging)
+        
+        return true;
+        
+    }
     
     ProcessorState::ProcessorState() {
 
@@ -48,29 +93,25 @@ namespace vm87 {
         
         psw = 0;
         
-    }
-    
-    bool ProcessorState::getZF() const {
+        lf_zn  = false;
+        lf_op  = LF_NONE;
+        lf_res = 0;
+        lf_dst = 0;
+        lf_src = 0;
         
-        return ((psw & (1 << 0)) != 0);
+        icount = 0;
         
     }
     
     bool ProcessorState::getOF() const {
         
-        return ((psw & (1 << 1)) != 0);
+        return ((getPSW() & (1 << 1)) != 0);
         
     }
     
     bool ProcessorState::getCF() const {
         
-        return ((psw & (1 << 2)) != 0);
-        
-    }
-    
-    bool ProcessorState::getNF() const {
-        
-        return ((psw & (1 << 3)) != 0);
+        return ((getPSW() & (1 << 2)) != 0);
         
     }
     
@@ -88,6 +129,8 @@ namespace vm87 {
     
     void ProcessorState::setZF(bool v) {
         
+        syncFlags();
+        
         if (v)
             psw |=  ((USHORT)1 << 0);
         else
@@ -97,6 +140,8 @@ namespace vm87 {
     
     void ProcessorState::setOF(bool v) {
         
+        syncFlags();
+        
         if (v)
             psw |=  ((USHORT)1 << 1);
         else
@@ -106,6 +151,8 @@ namespace vm87 {
     
     void ProcessorState::setCF(bool v) {
         
+        syncFlags();
+        
         if (v)
             psw |=  ((USHORT)1 << 2);
         else
@@ -115,6 +162,8 @@ namespace vm87 {
     
     void ProcessorState::setNF(bool v) {
         
+        syncFlags();
+        
         if (v)
             psw |=  ((USHORT)1 << 3);
         else
@@ -140,19 +189,120 @@ namespace vm87 {
         
     }
     
+    USHORT ProcessorState::getPSW() const {
+        
+        USHORT rv = psw;
+        
+        if (lf_zn) {
+            rv &= ~USHORT((1 << 0) | (1 << 3));
+            if (lf_res == 0) rv |= (1 << 0);
+            if (lf_res  < 0) rv |= (1 << 3);
+        }
+        
+        int  temp;
+        bool of;
+        
+        switch (lf_op) {
+            
+            case LF_ADD:
+                temp = int(lf_dst) + int(lf_src);
+                of   = (lf_dst < 0 && lf_src < 0 && short(temp) > 0) ||
+                       (lf_dst > 0 && lf_src > 0 && short(temp) < 0);
+                rv &= ~USHORT((1 << 1) | (1 << 2));
+                if (of) rv |= (1 << 1);
+                if (temp & (1 << 16)) rv |= (1 << 2);
+                break;
+                
+            case LF_SUB:
+                temp = int(lf_dst) - int(lf_src);
+                of   = (lf_dst > 0 && lf_src < 0 && short(temp) < 0) ||
+                       (lf_dst < 0 && lf_src > 0 && short(temp) > 0);
+                rv &= ~USHORT((1 << 1) | (1 << 2));
+                if (of) rv |= (1 << 1);
+                if (temp & (1 << 16)) rv |= (1 << 2);
+                break;
+                
+            case LF_SHL:
+                rv &= ~USHORT(1 << 2);
+                if (lf_dst & (1 << 15)) rv |= (1 << 2);
+                break;
+                
+            case LF_SHR:
+                rv &= ~USHORT(1 << 2);
+                if (lf_dst & 1) rv |= (1 << 2);
+                break;
+                
+            default:
+                break;
+                
+        }
+        
+        return rv;
+        
+    }
+    
+    void ProcessorState::setPSW(USHORT value) {
+        
+        psw   = value;
+        lf_zn = false;
+        lf_op = LF_NONE;
+        
+    }
+    
+    void ProcessorState::syncFlags() {
+        
+        setPSW(getPSW());
+        
+    }
+    
     ////////////////////////////////////////////////////////////////////////////
     
     Runtime::Runtime()
         : state()
-        , mem(USHORT_RANGE, 0) {
+        , mem(USHORT_RANGE, 0)
+        , decode(DecodeTable()) {
         
         debug = false;
         
+        init_done = false;
+        stop_at   = 0;
+        
+        profile   = nullptr;
+        callgraph = nullptr;
+        trace     = nullptr;
+        
         for (size_t i = 0; i < 8; i += 1)
             irq[i] = false;
         
+        for (size_t i = 0; i < 4; i += 1) {
+            sec_addr[i] = 0;
+            sec_len [i] = 0;
+        }
+        
+        // (Keys are handed to the keyboard by manageInterrupts, see key_latch)
+        devices.attach(MmioDevice{"icount",   IO_ICOUNT,   8u, PERM_R,          IcountRead,   nullptr,      nullptr});
+        devices.attach(MmioDevice{"keyboard", IO_KEYBOARD, 2u, PERM_R,          KeyboardRead, nullptr,      nullptr});
+        devices.attach(MmioDevice{"console",  IO_CONSOLE,  2u, PERM_R | PERM_W, nullptr,      ConsoleWrite, nullptr});
+        
+        buildPermissions();
+        
         irq_hand = 0;
         
+        poll_every    = 0; // Adaptive
+        timer_every   = 0; // Wall clock
+        poll_interval = POLL_MIN;
+        next_poll     = 0;
+        next_timer    = 0;
+        last_poll     = CLOCK::now();
+        
+        input     = nullptr;
+        use_getch = true;
+        key_frame = 0;
+        key_latch = 0;
+        
+        fault.kind    = Fault::NONE;
+        fault.address = 0;
+        
     }
     
 #define MIN(x, y) ((x>=y)?(y):(x))
@@ -173,40 +323,44 @@ namespace vm87 {
         
         // FETCH: (pos = ordinal in SymTab)
         
-        if (st.check(".text") == SymbolTable::DEFINED) {
+        const SymbolTableEntry * text = st.data.find(".text");
+        
+        if (text != nullptr && text->defined) {
             sec[cnt] = Section::Text;
-            pos[cnt] = st.data.at(".text").ordinal;
+            pos[cnt] = text->ordinal;
             len[cnt] = eh.sections[Section::Text].data.size();
             cnt += 1;
-            int val  = st.data.at(".text").value;
-            min_val  = size_t( MIN(min_val, size_t(val)) );
+            min_val  = size_t( MIN(min_val, size_t(text->value)) );
         }
         
-        if (st.check(".bss") == SymbolTable::DEFINED) {
+        const SymbolTableEntry * bss = st.data.find(".bss");
+        
+        if (bss != nullptr && bss->defined) {
             sec[cnt] = Section::BSS;
-            pos[cnt] = st.data.at(".bss").ordinal;
+            pos[cnt] = bss->ordinal;
             len[cnt] = eh.sections[Section::BSS].data.size();
             cnt += 1;
-            int val  = st.data.at(".bss").value;
-            min_val  = size_t( MIN(min_val, size_t(val)) );
+            min_val  = size_t( MIN(min_val, size_t(bss->value)) );
         }
         
-        if (st.check(".data") == SymbolTable::DEFINED) {
+        const SymbolTableEntry * data = st.data.find(".data");
+        
+        if (data != nullptr && data->defined) {
             sec[cnt] = Section::Data;
-            pos[cnt] = st.data.at(".data").ordinal;
+            pos[cnt] = data->ordinal;
             len[cnt] = eh.sections[Section::Data].data.size();
             cnt += 1;
-            int val  = st.data.at(".data").value;
-            min_val  = size_t( MIN(min_val, size_t(val)) );
+            min_val  = size_t( MIN(min_val, size_t(data->value)) );
         }
         
-        if (st.check(".rodata") == SymbolTable::DEFINED) {
+        const SymbolTableEntry * rodata = st.data.find(".rodata");
+        
+        if (rodata != nullptr && rodata->defined) {
             sec[cnt] = Section::ROData;
-            pos[cnt] = st.data.at(".rodata").ordinal;
+            pos[cnt] = rodata->ordinal;
             len[cnt] = eh.sections[Section::ROData].data.size();
             cnt += 1;
-            int val  = st.data.at(".rodata").value;
-            min_val  = size_t( MIN(min_val, size_t(val)) );
+            min_val  = size_t( MIN(min_val, size_t(rodata->value)) );
         }
         
         if (cnt == 0) return 0;
@@ -245,11 +399,11 @@ namespace vm87 {
         
     }
     
-    void Runtime::printState() const {
+    void Runtime::printState() {
         
-        cprint("| R 0 | R 1 | R 2 | R 3 | R 4 | R 5 | R 6 | R 7 | PSW |\n");
-        cprint("|-----|-----|-----|-----|-----|-----|-----|-----|-----|\n");
-        cprint("|%5d|%5d|%5d|%5d|%5d|%5d|%5d|%5d|%5X|\n"
+        console.print("| R 0 | R 1 | R 2 | R 3 | R 4 | R 5 | R 6 | R 7 | PSW |\n");
+        console.print("|-----|-----|-----|-----|-----|-----|-----|-----|-----|\n");
+        console.print("|%5d|%5d|%5d|%5d|%5d|%5d|%5d|%5d|%5X|\n"
             , (int)state.regs[0]
             , (int)state.regs[1]
             , (int)state.regs[2]
@@ -258,14 +412,14 @@ namespace vm87 {
             , (int)state.regs[5]
             , (int)state.regs[6]
             , (int)state.regs[7]
-            , (int)state.psw
+            , (int)state.getPSW()
             ) ;
         
     }
     
-    void Runtime::printInstrDesc(const InstructionDesc & desc, USHORT data) const {
+    void Runtime::printInstrDesc(const InstructionDesc & desc, USHORT data) {
         
-        cprint("OPCODE = %2d ; PRED = %d ; DSTAM = %d ; SRCAM = %d ; DATA = %d\n"
+        console.print("OPCODE = %2d ; PRED = %d ; DSTAM = %d ; SRCAM = %d ; DATA = %d\n"
             , int(desc.id - Command::Add)
             , int(desc.pred)
             , int(desc.dst_am)
@@ -275,17 +429,38 @@ namespace vm87 {
         
     }
     
+    void Runtime::traceInstruction(USHORT pc, const InstructionDesc & desc, USHORT data) {
+        
+        // State before the instruction:
+        std::fprintf(trace, "%llu %04X: %2d %d %d %d %04X | %04X %04X %04X %04X %04X %04X %04X %04X\n"
+            , state.icount
+            , unsigned(pc)
+            , int(desc.id - Command::Add)
+            , int(desc.pred)
+            , int(desc.dst_am)
+            , int(desc.src_am)
+            , unsigned(data)
+            , unsigned(state.regs[0]), unsigned(state.regs[1])
+            , unsigned(state.regs[2]), unsigned(state.regs[3])
+            , unsigned(state.regs[4]), unsigned(state.regs[5])
+            , unsigned(state.regs[6]), unsigned(state.getPSW())
+            ) ;
+        
+    }
+    
 #undef MIN
     
     void Runtime::loadFromELF(const ELFHolder& eh, bool cs) {
         
         // Quick-fail:
-        for (const auto & ste : eh.symtab.data) {
+        const SymbolStore & symbols = eh.symtab.data;
+        
+        for (size_t i = 1; i < symbols.ordinals(); i += 1) {
             
-            if (ste.second.ordinal == 0u) continue;
+            if (!symbols.has(i)) continue;
             
-            if (!ste.second.defined)
-                throw LoadError( "Undefined symbol [" + ste.first + "] found "
+            if (!symbols.entry(i).defined)
+                throw LoadError( "Undefined symbol [" + std::string(symbols.name(i)) + "] found "
                                  "in Symbol Table (only single-file programs "
                                  "are supported).");
             
@@ -320,61 +495,27 @@ namespace vm87 {
             std::memcpy( &(mem[pos[i]]), &(eh.sections[sec[i]].data[0]), len[i] );
         }
         
+        buildPermissions();
+        
         // RR: /////////////////////////////////////////////////////////////////
         
-        std::vector<std::pair<std::string, SymbolTableEntry>> rr_vec;
-        eh.symtab.toOrderedVector(rr_vec); // CREATE ORDERED SYMTAB VECTOR
+        std::vector<int> symvals;
+        eh.symtab.toValueVector(symvals); // Symbol values by ordinal
 
         for (size_t i = 0; i < cnt; i += 1) {
-
-            Section::Enum sect = sec[i];
             
-            for (const RelocRecord & rr : eh.relocations[sect]) {
-
-                //std::cout << "  At address " << /*pos[sect] +*/ rr.offset << "\n";
-                
-                void * raw_addr = &mem[/*pos[sect]  +*/ rr.offset]; // PEP
-
-                int symval = (rr_vec[rr.value].second).value;
-
-                switch (rr.type) {
-
-                    case RelocType::Abs_08: {
-                        char * addr = static_cast<char*>(raw_addr);
-                        *addr += static_cast<char>(symval);
-                    }
-                        break;
-
-                    case RelocType::Abs_16: {
-                        short * addr = static_cast<short*>(raw_addr);
-                        *addr += static_cast<short>(symval);
-                    }
-                        break;
-
-                    case RelocType::Abs_32: {
-                        int * addr = static_cast<int*>(raw_addr);
-                        *addr += static_cast<int>(symval);
-                    }
-                        break;
-
-                    case RelocType::PCRel_16: {
-                        USHORT * addr = static_cast<USHORT*>(raw_addr);
-                        *addr += static_cast<USHORT>(symval - rr.offset + 2);
-                    }
-                        break;
-
-                } // end_switch
-
-            } // end_for
-
-        } // end_for
+            applyRelocations(eh.relocations[sec[i]], symvals);
+            
+        }
         
         // REGS (pc / sp): /////////////////////////////////////////////////////
 
-        if (eh.symtab.check("_start") != SymbolTable::DEFINED)
+        const SymbolTableEntry * start = symbols.find("_start");
+        
+        if (start == nullptr || !start->defined)
             throw LoadError("Loaded ELF file does not define a '_start' symbol.");
         
-        if (eh.symtab.data.at("_start").section != Section::Text)
+        if (start->section != Section::Text)
             throw LoadError("Symbol '_start' must be in the .text section.");
         
         size_t text_ind = size_t(-1);
@@ -386,7 +527,7 @@ namespace vm87 {
         
         //std::cout << "text_ind = " << text_ind << "\n";
         
-        short _start = static_cast<short>(eh.symtab.data.at("_start").value);
+        short _start = static_cast<short>(start->value);
         if (!cs) {
             _start += static_cast<short>(pos[text_ind]);
         }
@@ -402,11 +543,11 @@ namespace vm87 {
         
         for (size_t i = 0; i < 8u; i += 1) {
             
-            if (eh.symtab.check(routines[i]) == SymbolTable::DEFINED) {
-                
-                int symval = eh.symtab.data.at(routines[i]).value;
+            const SymbolTableEntry * routine = symbols.find(routines[i]);
+            
+            if (routine != nullptr && routine->defined) {
                 
-                USHORT sa = USHORT(symval);
+                USHORT sa = USHORT(routine->value);
                 
                 //std::cout << "Setting IVT " << i << " to " << sa << "\n";
                 
@@ -418,28 +559,195 @@ namespace vm87 {
         
     }
 
+    void Runtime::loadFromImage(const ProgramImage & img) {
+        
+        // Everything was placed and checked by the converter (and the bounds
+        // once more by ProgramImage::open), so this only copies and patches.
+        
+        const ImageHeader & hdr = img.header();
+        
+        for (size_t i = 0; i < hdr.sec_cnt; i += 1) {
+            
+            const ImageSection & is = img.sections()[i];
+            
+            sec_addr[is.section] = is.addr;
+            sec_len [is.section] = is.size;
+            
+            std::memcpy( &(mem[is.addr]), img.data(is), is.size );
+            
+        }
+        
+        buildPermissions();
+        
+        const ImageSymbol * sym = img.symbols();
+        const ImageReloc  * rel = img.relocs();
+        
+        std::vector<int> symvals(hdr.sym_cnt);
+        
+        for (size_t i = 0; i < hdr.sym_cnt; i += 1)
+            symvals[i] = sym[i].value;
+        
+        std::vector<RelocRecord> rrs;
+        rrs.reserve(hdr.rel_cnt);
+        
+        for (size_t i = 0; i < hdr.rel_cnt; i += 1)
+            rrs.emplace_back(RelocType::Enum(rel[i].type), rel[i].offset, rel[i].symbol);
+        
+        applyRelocations(rrs, symvals);
+        
+        state.regs[PC] = hdr.entry;
+        state.regs[SP] = SP_INIT;
+        
+        std::memcpy( &(mem[0]), hdr.ivt, sizeof(hdr.ivt) );
+        
+    }
+    
+    // One run of same-type records: T is the patched field, pcrel adds the
+    // distance from the end of the field (symbol - offset + 2).
+    template <typename T>
+    static
+    void ApplyRelocRun
+        ( unsigned char * mem
+        , const RelocRecord * rr
+        , const RelocRecord * end
+        , const int * symvals
+        , bool pcrel
+        ) {
+        
+        for (; rr != end; ++rr) {
+            
+            T field;
+            
+            std::memcpy(&field, mem + rr->offset, sizeof(T));
+            
+            field += pcrel ? T(symvals[rr->value] - rr->offset + 2)
+                           : T(symvals[rr->value]);
+            
+            std::memcpy(mem + rr->offset, &field, sizeof(T));
+            
+        }
+        
+    }
+    
+    void Runtime::applyRelocations
+        ( const std::vector<RelocRecord> & rrs
+        , const std::vector<int> & symvals
+        ) {
+        
+        // Checked up front, so the runs below need no checks:
+        for (const RelocRecord & rr : rrs) {
+            
+            if (rr.value >= symvals.size())
+                throw LoadError("Relocation refers to a missing symbol.");
+            
+            if (rr.offset > mem.size() - RelocWidth(rr.type))
+                throw LoadError("Relocation exceeds memory boundaries.");
+            
+        }
+        
+        const RelocRecord * rr  = rrs.data();
+        const RelocRecord * end = rr + rrs.size();
+        
+        while (rr != end) {
+            
+            // Consecutive records of the same type (mostly all of them):
+            const RelocRecord * run = rr + 1;
+            
+            while (run != end && run->type == rr->type) ++run;
+            
+            switch (rr->type) {
+                
+                case RelocType::Abs_08:
+                    ApplyRelocRun<char>(&mem[0], rr, run, symvals.data(), false);
+                    break;
+                    
+                case RelocType::Abs_16:
+                    ApplyRelocRun<short>(&mem[0], rr, run, symvals.data(), false);
+                    break;
+                    
+                case RelocType::Abs_32:
+                    ApplyRelocRun<int>(&mem[0], rr, run, symvals.data(), false);
+                    break;
+                    
+                case RelocType::PCRel_16:
+                    ApplyRelocRun<USHORT>(&mem[0], rr, run, symvals.data(), true);
+                    break;
+                    
+                default:
+                    break;
+                    
+            }
+            
+            rr = run;
+            
+        }
+        
+    }
+    
     void Runtime::runProgram(bool do_debug) {
         
         debug = do_debug;
         
-        InstructionDesc desc{};
-        USHORT data;
+        fault.kind = Fault::NONE;
         
         TIME_POINT tp = CLOCK::now();
         
-        callInterrupt(INT_INIT);
+        if (callgraph != nullptr) callgraph->start(state.regs[PC], state.icount);
+        
+        if (!init_done) {
+            init_done = true;
+            counters.irq_raised[INT_INIT] += 1;
+            if (!callInterrupt(INT_INIT) && fault.pending()) throwFault();
+        }
+        
+        // The variant is picked once, here:
+        bool profiling = (profile != nullptr || callgraph != nullptr);
+        
+        if (debug) {
+            
+            ConsoleOutput::Policy policy = console.getPolicy();
+            
+            console.setPolicy(ConsoleOutput::FLUSH_DEBUG);
+            
+            runLoop<LoopDebug>(tp);
+            
+            console.setPolicy(policy);
+            
+        }
+        else if (profiling && trace != nullptr) runLoop<LoopProfileTrace>(tp);
+        else if (profiling)                     runLoop<LoopProfile>(tp);
+        else if (trace != nullptr)              runLoop<LoopTrace>(tp);
+        else                                    runLoop<LoopPlain>(tp);
+        
+        // (The loops return on an unhandled fault)
+        if (fault.pending()) throwFault();
+        
+    }
+    
+    template <class Policy>
+    void Runtime::runLoop(TIME_POINT & tp) {
+        
+        USHORT data = 0;
+        
+        ProfileCounters * pcs = (Policy::PROFILE && profile != nullptr) ? profile->pcs.data() : nullptr;
         
         while (true) {
         
-            if (debug) printState();
+            if (Policy::STEP) printState();
             
             // FETCH:
-            fetchInstruction(desc, data);
+            USHORT pc = state.regs[PC];
+            
+            const InstructionDesc * fetched = fetchInstruction(data);
+            
+            if (fetched == nullptr) return; // (Execute violations are never handled)
+            
+            const InstructionDesc & desc = *fetched;
 
-            if (debug) {
+            if (Policy::STEP) {
                 
                 printInstrDesc(desc, data);
-                cprint("Press ENTER to Step ");
+                console.print("Press ENTER to Step ");
                 while (1) {
                     
                     int choice = getch();
@@ -452,55 +760,98 @@ namespace vm87 {
                         return;
                     
                 }
-                cprint("\n");
+                console.print("\n");
                 
             }
             
-            // EXECUTE:
-            try {
+            if (Policy::TRACE) traceInstruction(pc, desc, data);
+            
+            // (Executed - for the call graph events)
+            bool event = false;
+            
+            USHORT sp = state.regs[SP];
+            
+            if (Policy::PROFILE) {
+                
+                bool taken = (desc.pred == Predicate::Al) || CheckPredicate(state, desc.pred);
                 
-                executeInstruction(desc, data);
+                if (pcs != nullptr && desc.pred != Predicate::Al) {
+                    if (taken)
+                        pcs[pc].taken += 1;
+                    else
+                        pcs[pc].skipped += 1;
+                }
                 
-            } catch (ViolationError & ex) {
+                event = taken && callgraph != nullptr &&
+                        ( desc.id == Command::Call || desc.id == Command::Iret ||
+                         (desc.id == Command::Pop && desc.dst_am == AddrMode::RegDir &&
+                          desc.dst_reg_no == PC) ); // (RetP)
                 
-                if (!callInterrupt(INT_VIOLATION)) {
-                    
-                    throw;
+            }
+            
+            // EXECUTE:
+            bool executed = executeInstruction(desc, data);
+            
+            // (A faulting instruction is retired before the handler is entered,
+            // so the profile and the call graph both charge it to pc)
+            state.icount += 1;
+            
+            if (Policy::PROFILE) {
+                
+                if (pcs != nullptr) pcs[pc].retired += 1;
                 
+                if (event && executed) {
+                    if (desc.id == Command::Call)
+                        callgraph->enter(state.regs[PC], state.regs[SP], state.icount);
+                    else
+                        callgraph->leave(sp, state.icount);
                 }
                 
             }
             
-            // INTERRUPTS:
-            manageInterrupts(tp);
+            if (!executed && !trapViolation()) return;
+            
+            // INTERRUPTS (host time and input every instruction when stepping):
+            if (Policy::STEP) next_poll = state.icount;
+            
+            if (!manageInterrupts(tp)) return;
             
             // END OF PROGRAM (if psw & (1 << 10) != 0):
             if ( (state.psw & USHORT(1 << 10)) != 0 ) break;
             
+            // CHECKPOINT (see vm87 snapshot):
+            if (stop_at != 0 && state.icount >= stop_at) break;
+            
         }
         
     }
     
     bool Runtime::callInterrupt(int ordinal) {
         
-        USHORT ptr = memLoad(USHORT(ordinal * 2));
+        USHORT ptr;
+        
+        if (!memLoad(USHORT(ordinal * 2), ptr)) return false;
         
         if (ptr != 0) {
 
             if (state.regs[SP] <= 16)
                 throw UnrecError("Stack overflow.");
             state.regs[SP] -= 2;
-            memStore(state.regs[SP], state.regs[PC]);
+            if (!memStore(state.regs[SP], state.regs[PC])) return false;
 
             if (state.regs[SP] <= 16)
                 throw UnrecError("Stack overflow.");
             state.regs[SP] -= 2;
-            memStore(state.regs[SP], state.psw);
+            if (!memStore(state.regs[SP], state.getPSW())) return false;
 
             // FLAGS - STUB
             
             state.regs[PC] = ptr;
             
+            counters.irq_taken[ordinal] += 1;
+            
+            if (callgraph != nullptr) callgraph->enter(ptr, state.regs[SP], state.icount);
+            
             return true;
 
         }
@@ -509,28 +860,45 @@ namespace vm87 {
         
     }
     
-    void Runtime::fetchInstruction(InstructionDesc & desc, USHORT & data) {
+    bool Runtime::trapViolation() {
         
-        const void * raw_addr;
+        counters.violations += 1;
+        counters.irq_raised[INT_VIOLATION] += 1;
+        
+        Fault pending = fault;
+        
+        fault.kind = Fault::NONE;
         
-        bool dst, src;
+        if (callInterrupt(INT_VIOLATION)) return true;
+        
+        // (A fault while calling the handler replaces this one)
+        if (!fault.pending()) fault = pending;
+        
+        return false;
+        
+    }
+    
+    void Runtime::throwFault() const {
         
-        accessAddress(state.regs[PC] + 0u, EXECUTE);
-        accessAddress(state.regs[PC] + 1u, EXECUTE);
+        throw ViolationError(fault.message());
+        
+    }
+    
+    const InstructionDesc * Runtime::fetchInstruction(USHORT & data) {
+        
+        const void * raw_addr;
+        
+        if (!accessWord(state.regs[PC], EXECUTE)) return nullptr;
         
         raw_addr = &(mem[state.regs[PC]]);
         state.regs[PC] += 2;
         USHORT encoded = *(USHORT*)raw_addr;
         
-        desc = InstructionDesc(encoded);
+        const InstructionDesc & desc = decode[encoded];
         
-        InstructionOperands(desc.id, dst, src);
-        
-        if ((dst && (desc.dst_am != AddrMode::RegDir)) ||
-            (src && (desc.src_am != AddrMode::RegDir))) {
+        if (desc.has_data) {
             
-            accessAddress(state.regs[PC] + 0u, EXECUTE);
-            accessAddress(state.regs[PC] + 1u, EXECUTE);
+            if (!accessWord(state.regs[PC], EXECUTE)) return nullptr;
             
             raw_addr = &(mem[state.regs[PC]]);
             state.regs[PC] += 2;
@@ -538,187 +906,110 @@ namespace vm87 {
             
         }
         
+        return &desc;
+        
     }
     
-    void Runtime::executeInstruction(const InstructionDesc & desc, USHORT data) {
+    bool Runtime::executeInstruction(const InstructionDesc & desc, USHORT data) {
         
         // Check predicate:
-        switch (desc.pred) {
-            case Predicate::Eq:
-                if (!state.getZF()) return;
-                break;
-            case Predicate::Ne:
-                if (state.getZF()) return;
-                break;
-            case Predicate::Gt:
-                if (state.getNF() || state.getZF()) return;
-                break;
-            default:
-                break;
-        }
-        
-         short dst_s, src_s, res_s;
-        USHORT dst_u, src_u, res_u;
-        
-        switch (desc.id) {
-            
-            case Command::Add:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s + src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
-            case Command::Sub:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s - src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
-            case Command::Mul:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s * src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
-            case Command::Div:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                if (src_s == 0)
-                    throw ViolationError("Division by zero.");
-                res_s = dst_s / src_s;
-                storeValueSigned(desc, data, res_s);
-                break; 
-                
-            case Command::Cmp:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s - src_s;
-                //storeValueSigned(desc, data, val_s);//
-                break;
-                
-            case Command::And:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s & src_s;
-                storeValueSigned(desc, data, res_s);
-                break; 
-                
-            case Command::Or:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s | src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
-            case Command::Not:
-                dst_s = ~loadValueSigned(desc, data, SRC);
-                storeValueSigned(desc, data, dst_s);
-                break; 
-                
-            case Command::Test:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s & src_s;
-                //storeValueSigned(desc, data, val_s);//
-                break;
-                
-            case Command::Push: // sp -= 2; mem[sp] = src
-                if (state.regs[SP] <= 16)
-                    throw UnrecError("Stack overflow.");
-                state.regs[SP] -= 2;
-                src_u = loadValueUnsigned(desc, data, SRC);
-                memStore(state.regs[SP], src_u);
-                break;
-                
-            case Command::Pop: // dst = mem[sp]; sp += 2
-                if (state.regs[SP] >= SP_INIT)
-                    throw UnrecError("Stack underflow.");
-                dst_u = memLoad(state.regs[SP]);
-                storeValueUnsigned(desc, data, dst_u);
-                state.regs[SP] += 2;
-                break;
-                
-            case Command::Call: // push pc; pc=src
-                state.regs[SP] -= 2;
-                memStore(state.regs[SP], state.regs[PC]);
-                state.regs[PC] = loadValueUnsigned(desc, data, SRC);
-                break;
-                
-            case Command::Iret: // pop psw; pop pc
-                dst_u = memLoad(state.regs[SP]);
-                state.regs[SP] += 2;
-                state.psw = dst_u;
-                dst_u = memLoad(state.regs[SP]);
-                state.regs[SP] += 2;
-                state.regs[PC] = dst_u;
-                break;
-                
-            case Command::Mov:
-                src_s = loadValueSigned(desc, data, SRC);
-                storeValueSigned(desc, data, src_s); // !!!!!!!!!!!!!!!!!!
-                break;
-                
-            case Command::Shl:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s << src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
-            case Command::Shr:
-                dst_s = loadValueSigned(desc, data, DST);
-                src_s = loadValueSigned(desc, data, SRC);
-                res_s = dst_s >> src_s;
-                storeValueSigned(desc, data, res_s);
-                break;
-                
+        if (!CheckPredicate(state, desc.pred)) {
+            counters.skipped += 1;
+            return true;
         }
         
-        // Update flags (unsigned values are redundant...);
-        setFlags(desc, dst_s, src_s, res_s, dst_u, src_u, res_u);
+        // Execute (and update flags):
+        return EXEC_HANDLERS[desc.handler](*this, desc, data);
         
     }
     
-    void Runtime::manageInterrupts(TIME_POINT & tp) {
+    bool Runtime::manageInterrupts(TIME_POINT & tp) {
         
         // Initialization:
         // --not here
         
-        // Timer:
-        TIME_POINT tp2 = CLOCK::now();
-        auto diff = tp2 - tp;
-        
-        int diff_ms = 
-            std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
+        // Timer (virtual):
+        if (timer_every != 0 && state.icount >= next_timer) {
+            
+            next_timer = state.icount + timer_every;
+            
+            if (state.getTF()) raiseInterrupt(INT_TIMER);
+            
+        }
         
-        if (diff_ms >= 1000) {
+        // Host time and input:
+        if (state.icount >= next_poll) {
             
-            tp = tp2;
+            TIME_POINT tp2 = CLOCK::now();
             
-            if (state.getTF()) {
+            if (poll_every != 0) {
+                
+                poll_interval = poll_every;
+                
+            } else {
                 
-                irq[INT_TIMER] = true;
+                long us = long(std::chrono::duration_cast<std::chrono::microseconds>
+                                   (tp2 - last_poll).count());
                 
-                //std::cout << "Timer\n";
+                if (us < POLL_TARGET_US / 2 && poll_interval < POLL_MAX)
+                    poll_interval *= 2;
+                else if (us > POLL_TARGET_US * 2 && poll_interval > POLL_MIN)
+                    poll_interval /= 2;
                 
             }
             
-        }
-        
-        // Violation:
-        // --not here
-        
-        // Key press:
-        int ch;
-        if ((ch = getch()) == ERR) {
-            // No input
-        }
-        else {
-            memStore(USHORT(0xFFFC), gen::pun_s_to_u<short>(short(ch)));
-            irq[INT_KEYSTROKE] = true;
+            last_poll = tp2;
+            next_poll = state.icount + poll_interval;
+            
+            // Timer (wall clock):
+            if (timer_every == 0) {
+                
+                auto diff = tp2 - tp;
+                
+                int diff_ms = 
+                    std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
+                
+                if (diff_ms >= 1000) {
+                    
+                    tp = tp2;
+                    
+                    if (state.getTF()) {
+                        
+                        raiseInterrupt(INT_TIMER);
+                        
+                        //std::cout << "Timer\n";
+                        
+                    }
+                    
+                }
+                
+            }
+            
+            // Console output:
+            console.poll();
+            
+            // Violation:
+            // --not here
+            
+            // Key press (queued keys are delivered one per interrupt):
+            int ch;
+            if (input != nullptr) {
+                // (Not before the handler is done with the previous one)
+                if (key_frame != 0 && state.regs[SP] > key_frame) key_frame = 0;
+                if (!irq[INT_KEYSTROKE] && key_frame == 0 &&
+                    input->pending() && input->pop(ch)) {
+                    key_latch = gen::pun_s_to_u<short>(short(ch));
+                    raiseInterrupt(INT_KEYSTROKE);
+                }
+            }
+            else if (!use_getch || (ch = getch()) == ERR) {
+                // No input
+            }
+            else {
+                key_latch = gen::pun_s_to_u<short>(short(ch));
+                raiseInterrupt(INT_KEYSTROKE);
+            }
+            
         }
         
         // Execute:
@@ -733,12 +1024,38 @@ namespace vm87 {
                 
             irq[i] = false;
             
-            callInterrupt(i);
+            if (callInterrupt(i)) {
+                if (i == INT_KEYSTROKE) key_frame = state.regs[SP];
+            } else if (fault.pending()) {
+                return false;
+            }
             
             break;
             
         }
         
+        return true;
+        
+    }
+    
+    unsigned long long Runtime::nextEvent() const {
+        
+        if (debug) return state.icount;
+        
+        // (A pending interrupt is taken after the very next instruction)
+        bool pending = false;
+        
+        for (int i = 0; i < 8; i += 1) pending |= irq[i];
+        
+        if (pending) {
+            for (int i = 0; i < 8; i += 1)
+                if (irq[i] && (!state.getMF() || i == INT_VIOLATION)) return state.icount;
+        }
+        
+        if (timer_every != 0 && next_timer < next_poll) return next_timer;
+        
+        return next_poll;
+        
     }
     
     // Execute helpers:
@@ -748,41 +1065,64 @@ namespace vm87 {
 #define bss    Section::BSS
 #define rodata Section::ROData
     
-    void Runtime::accessAddress(USHORT address, int action) const {
+    void Runtime::buildPermissions() {
+        
+        // One byte past the end stays inaccessible (a word at 0xFFFF would
+        // be out of memory):
+        perm.assign(USHORT_RANGE + 1, 0);
+        
+        struct { size_t addr, len; unsigned char bits; } areas[] = {
+            { 0u,                   SP_INIT,            PERM_R | PERM_W }, // IVT + stack
+            { USHORT_RANGE - 128u,  128u,               PERM_R | PERM_W }, // I/O
+            { sec_addr[text],       sec_len[text],      PERM_R | PERM_X },
+            { sec_addr[data],       sec_len[data],      PERM_R | PERM_W },
+            { sec_addr[bss],        sec_len[bss],       PERM_R | PERM_W },
+            { sec_addr[rodata],     sec_len[rodata],    PERM_R          }
+        };
+        
+        for (const auto & area : areas)
+            for (size_t i = area.addr; i < area.addr + area.len && i < USHORT_RANGE; i += 1)
+                perm[i] |= area.bits;
+        
+        // Devices (rights of their ranges, hooks):
+        for (size_t d = 0; d < devices.size(); d += 1) {
+            
+            const MmioDevice & dev = devices.at(d);
+            
+            unsigned char bits = dev.perm;
+            
+            if (dev.read  != nullptr) bits |= PERM_IO_R;
+            if (dev.write != nullptr) bits |= PERM_IO_W;
+            
+            for (size_t i = dev.addr; i < size_t(dev.addr) + dev.len; i += 1)
+                perm[i] = bits;
+                
+        }
+        
+    }
+    
+    void Runtime::attachDevice(const MmioDevice & dev) {
+        
+        devices.attach(dev);
         
-        const USHORT a = address;
+        buildPermissions();
+        
+    }
+    
+    bool Runtime::accessViolation(USHORT address, int action) {
+        
+        // Report the failing byte (accessWord checks two):
+        if ((perm[address] & (1u << action)) != 0) address += 1;
         
         switch (action) {
             
             case READ:
-                if ( InRange(a, sec_addr[text], sec_len[text])     ||
-                     InRange(a, sec_addr[data], sec_len[data])     ||
-                     InRange(a, sec_addr[bss], sec_len[bss])       ||
-                     InRange(a, sec_addr[rodata], sec_len[rodata]) ||
-                     InRange(a, 0u, SP_INIT) || InRange(a, (65536u - 128u), 128) )
-                    return;
-                throw ViolationError( "Read access violation on "
-                                      "address " + std::to_string(a));
-                break;
-                
             case WRITE:
-                if ( InRange(a, sec_addr[data], sec_len[data]) ||
-                     InRange(a, sec_addr[bss], sec_len[bss])   ||
-                     InRange(a, 0u, SP_INIT) || InRange(a, (65536u - 128u), 128) )
-                    return;
-                throw ViolationError( "Write access violation on "
-                                      "address " + std::to_string(a));
-                break;
-                
             case EXECUTE:
-                if (InRange(a, sec_addr[text], sec_len[text])) return;
-                throw ViolationError( "Execute access violation on "
-                                      "address " + std::to_string(a));
-                break;
+                return setFault(static_cast<unsigned char>(Fault::READ + action), address);
                 
             default:
                 throw UnrecError("vm87::Runtime::accessAddress(...) - Unknown action.");
-                break;
             
         }
         
@@ -793,187 +1133,68 @@ namespace vm87 {
 #undef bss
 #undef rodata
     
-    USHORT Runtime::memLoad(USHORT address) {
-        
-        accessAddress(address + 0u, READ);
-        accessAddress(address + 1u, READ);
-        
-        USHORT rv;
+    std::string Fault::message() const {
         
-        std::memcpy(&rv, &mem[address], sizeof(USHORT));
+        const std::string a = std::to_string(address);
         
-        return rv;
-        
-    }
-        
-    void Runtime::memStore(USHORT address, USHORT value) {
-        
-        accessAddress(address + 0u, WRITE);
-        accessAddress(address + 1u, WRITE);
-        
-        std::memcpy(&mem[address], &value, sizeof(USHORT));
-        
-        if ((int)address == 0xFFFE) { // Console output
-            
-            char c;
-            
-            if (value == 10)
-                c = '\n';
-            else
-                c = static_cast<char>(value);
-            
-            if (debug) cprint("CONSOLE OUTPUT: ");
-            
-            cprint("%c", c);
-            //printf("%c", c);
+        switch (kind) {
             
-            if (debug) cprint("\n");
-            
-        }
-        
-    }
-    
-    USHORT Runtime::loadValueUnsigned(const InstructionDesc & desc, USHORT data, bool place) {
-        
-        USHORT rv;
-        
-        AddrMode::Enum mode = ((place == DST)?(desc.dst_am):(desc.src_am));
-        unsigned reg_no     = ((place == DST)?(desc.dst_reg_no):(desc.src_reg_no));
-        
-        switch (mode) {
-            
-            case AddrMode::Imm:
-                if (reg_no == 0x7) return state.psw;
-                return data;
+            case READ:
+                return "Read access violation on address " + a;
+                
+            case WRITE:
+                return "Write access violation on address " + a;
                 
-            case AddrMode::MemDir:
-                return memLoad(data);
+            case EXECUTE:
+                return "Execute access violation on address " + a;
                 
-            case AddrMode::RegDir:
-                return state.regs[reg_no];
+            case DIVIDE:
+                return "Division by zero.";
                 
-            case AddrMode::RegInd:
-                return memLoad(state.regs[reg_no] + data);
+            default:
+                return "No fault.";
             
         }
         
     }
     
-    short Runtime::loadValueSigned(const InstructionDesc & desc, USHORT data, bool place) {
+    bool Runtime::memLoadSlow(USHORT address, USHORT & value) {
         
-        USHORT temp = loadValueUnsigned(desc, data, place);
+        if (!accessWord(address, READ)) return false;
         
-        return gen::pun_u_to_s<short>(temp);
+        counters.loads += 1;
         
-    }
-    
-    void Runtime::storeValueUnsigned(const InstructionDesc & desc, USHORT data, USHORT value) {
+        const MmioDevice * dev = devices.find(address);
         
-        AddrMode::Enum mode = desc.dst_am;
-        unsigned reg_no     = desc.dst_reg_no;
+        // (Plain memory reaching into a device)
+        if (dev == nullptr || dev->read == nullptr) dev = devices.find(USHORT(address + 1u));
         
-        switch (mode) {
-            
-            case AddrMode::Imm:
-                if (reg_no == 0x7)
-                    state.psw = value;
-                else {
-                    /* STUB - ERROR */
-                }
-                break;
-                
-            case AddrMode::MemDir:
-                memStore(data, value);
-                break;
-                
-            case AddrMode::RegDir:
-                state.regs[reg_no] = value;
-                break;
-                
-            case AddrMode::RegInd:
-                memStore(state.regs[reg_no] + data, value);
-                break;
+        if (dev != nullptr && dev->read != nullptr)
+            return dev->read(*this, dev->user, address, value);
             
-        }
+        std::memcpy(&value, &mem[address], sizeof(USHORT));
+        
+        return true;
         
     }
     
-    void Runtime::storeValueSigned(const InstructionDesc & desc, USHORT data, short value) {
+    bool Runtime::memStoreSlow(USHORT address, USHORT value) {
         
-        storeValueUnsigned(desc, data, gen::pun_s_to_u<short>(value));
+        if (!accessWord(address, WRITE)) return false;
         
-    }
-     
-    void Runtime::setFlags
-        ( const InstructionDesc & desc
-        , short dst_s
-        , short src_s
-        , short res_s
-        , USHORT dst_u
-        , USHORT src_u
-        , USHORT res_u
-        ) {
+        counters.stores += 1;
         
-        int temp;
-        
-        switch (desc.id) {
-                
-            case Command::Sub: // zocn
-            case Command::Cmp:
-                temp = int(dst_s) - int(src_s);
-                if ((dst_s > 0 && src_s < 0 && res_s < 0) ||
-                    (dst_s < 0 && src_s > 0 && res_s > 0))
-                    state.setOF(true);
-                else
-                    state.setOF(false);
-                
-            case Command::Add: // zocn
-                if (desc.id == Command::Add) {
-                    temp = int(dst_s) + int(src_s);
-                    if ((dst_s < 0 && src_s < 0 && res_s > 0) ||
-                        (dst_s > 0 && src_s > 0 && res_s < 0))
-                        state.setOF(true);
-                    else
-                        state.setOF(false);
-                }
-                
-                state.setCF(temp & (1 << 16));
-                
-            case Command::Mul: // zn
-            case Command::Div:
-            case Command::And:
-            case Command::Or:
-            case Command::Not:
-            case Command::Test:
-                state.setZF(res_s == 0);
-                state.setNF(res_s  < 0);
-                break;
-          
-            case Command::Mov: // zn // !!!!!!!!!!!!!!!!!!!!!
-                state.setZF(src_s == 0);
-                state.setNF(src_s  < 0);
-                break;
-                
-            case Command::Shl: // zcn
-                state.setZF(res_s == 0);
-                state.setNF(res_s  < 0);
-                state.setCF(dst_s  & (1 << 15));
-                break;
-                
-            case Command::Shr: // zcn
-                state.setZF(res_s == 0);
-                state.setNF(res_s  < 0);
-                state.setCF(dst_s  & 1);
-                break;
-                
-            case Command::Push:
-            case Command::Pop:
-            case Command::Call:
-            case Command::Iret: 
-                // No change
-                break;
-                
-        }
+        std::memcpy(&mem[address], &value, sizeof(USHORT));
+        
+        const MmioDevice * dev = devices.find(address);
+        
+        // (Plain memory reaching into a device)
+        if (dev == nullptr || dev->write == nullptr) dev = devices.find(USHORT(address + 1u));
+        
+        if (dev != nullptr && dev->write != nullptr)
+            return dev->write(*this, dev->user, address, value);
+            
+        return true;
         
     }
     
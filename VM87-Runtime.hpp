@@ -5,12 +5,24 @@
 #include <vector>
 #include <stdexcept>
 #include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <string>
 
 #include "Asem-Enumeration.hpp"
 #include "Asem-ELFHolder.hpp"
+#include "VM87-Decode.hpp"
+#include "VM87-Console.hpp"
+#include "VM87-Counters.hpp"
+#include "VM87-Mmio.hpp"
 
 namespace vm87 {
     
+    class InputThread;
+    class ProgramImage;
+    struct Profile;
+    class CallGraph;
+    
     typedef unsigned short           USHORT;
     typedef std::chrono::steady_clock CLOCK;
     typedef CLOCK::time_point    TIME_POINT;
@@ -19,6 +31,27 @@ namespace vm87 {
     typedef std::runtime_error   UnrecError; // (Unrecoverable) Stops the program
     typedef std::logic_error ViolationError; // Interrupts the program
     
+    // A violation (see Runtime::fault). The memory and execute helpers record
+    // it and return false instead of throwing, so a violation the program
+    // handles costs about as much as the interrupt call. Only one left
+    // unhandled is turned into a ViolationError, by the engine's runProgram.
+    struct Fault {
+        
+        static const unsigned char NONE    = 0;
+        static const unsigned char READ    = 1; // Access violations (READ + action)
+        static const unsigned char WRITE   = 2;
+        static const unsigned char EXECUTE = 3;
+        static const unsigned char DIVIDE  = 4; // Division by zero
+        
+        unsigned char kind;
+        USHORT address; // Failing byte (access violations)
+        
+        bool pending() const { return kind != NONE; }
+        
+        std::string message() const; // (As the ViolationError says it)
+        
+    };
+    
     struct ProcessorState {
         
         USHORT regs[8];
@@ -29,6 +62,25 @@ namespace vm87 {
         // [2] - C
         // [3] - N
         
+        // Lazy flags: the last flag-producing operation is only recorded
+        // and Z/N/C/O get computed when they are actually needed (predicates,
+        // psw used as an operand or pushed). Read the PSW with getPSW() and
+        // write it with setPSW(), never directly through psw.
+        
+        static const unsigned char LF_NONE = 0; // psw is up to date
+        static const unsigned char LF_ADD  = 1; // O, C (from lf_dst, lf_src)
+        static const unsigned char LF_SUB  = 2; // O, C (from lf_dst, lf_src)
+        static const unsigned char LF_SHL  = 3; // C    (from lf_dst)
+        static const unsigned char LF_SHR  = 4; // C    (from lf_dst)
+        
+        bool lf_zn;          // Z, N pending (from lf_res)
+        unsigned char lf_op; // O/C pending (LF_...)
+        short lf_res;
+        short lf_dst;
+        short lf_src;
+        
+        unsigned long long icount; // Retired instructions
+        
         ProcessorState();
         
         bool getZF() const;
@@ -45,26 +97,83 @@ namespace vm87 {
         void setMF(bool v);
         void setTF(bool v);
         
+        USHORT getPSW() const;
+        void   setPSW(USHORT value);
+        
+        void syncFlags(); // Write pending flags to psw
+        
+        void lazyZN(short res);
+        void lazyArith(unsigned char op, short dst, short src, short res);
+        void lazyShift(unsigned char op, short dst, short res);
+        
     };
     
-    struct InstructionDesc {
+    inline
+    bool ProcessorState::getZF() const {
         
-        asem::Predicate::Enum pred;
-        asem::Command::Enum   id;
-        asem::AddrMode::Enum  dst_am;
-        asem::AddrMode::Enum  src_am;
+        return lf_zn ? (lf_res == 0) : ((psw & (1 << 0)) != 0);
         
-        unsigned dst_reg_no;
-        unsigned src_reg_no;
+    }
+    
+    inline
+    bool ProcessorState::getNF() const {
         
-        InstructionDesc();
+        return lf_zn ? (lf_res < 0) : ((psw & (1 << 3)) != 0);
         
-        InstructionDesc(unsigned short encoded);
+    }
+    
+    inline
+    void ProcessorState::lazyZN(short res) {
         
-    };
+        lf_zn  = true;
+        lf_res = res;
+        
+    }
+    
+    inline
+    void ProcessorState::lazyArith(unsigned char op, short dst, short src, short res) {
+        
+        lazyZN(res);
+        
+        lf_op  = op;
+        lf_dst = dst;
+        lf_src = src;
+        
+    }
+    
+    inline
+    void ProcessorState::lazyShift(unsigned char op, short dst, short res) {
+        
+        // Shifts leave O alone - keep the one from a pending add/sub:
+        if (lf_op == LF_ADD || lf_op == LF_SUB) syncFlags();
+        
+        lazyZN(res);
+        
+        lf_op  = op;
+        lf_dst = dst;
+        
+    }
     
     ////////////////////////////////////////////////////////////////////////////
     
+    // Run loop variants (see Runtime::runLoop). Each is a set of compile-time
+    // switches, so the loop built for it contains only its own
+    // instrumentation - the plain one has none.
+    template <bool STEP_, bool TRACE_, bool PROFILE_>
+    struct RunPolicy {
+        
+        static const bool STEP    = STEP_;    // Step by step (debug mode)
+        static const bool TRACE   = TRACE_;   // A line per instruction (Runtime::trace)
+        static const bool PROFILE = PROFILE_; // Runtime::profile / callgraph
+        
+    };
+    
+    typedef RunPolicy<false, false, false> LoopPlain;
+    typedef RunPolicy<true,  false, false> LoopDebug;
+    typedef RunPolicy<false, true,  false> LoopTrace;
+    typedef RunPolicy<false, false, true > LoopProfile;
+    typedef RunPolicy<false, true,  true > LoopProfileTrace;
+    
     class Runtime {
         
     public:
@@ -76,16 +185,37 @@ namespace vm87 {
         static const int WRITE   = 1;
         static const int EXECUTE = 2;
         
+        // Permission bits (in perm):
+        static const unsigned char PERM_R = (1u << READ);
+        static const unsigned char PERM_W = (1u << WRITE);
+        static const unsigned char PERM_X = (1u << EXECUTE);
+        
+        // Hooked by a device (see MmioRegistry):
+        static const unsigned char PERM_IO_R = (PERM_R << 3);
+        static const unsigned char PERM_IO_W = (PERM_W << 3);
+        
         static const USHORT SP_INIT = 1024u;
         
-        static const bool DST = 0;
-        static const bool SRC = 1;
+        // Built-in devices (see devices):
+        
+        // Instructions retired (icount, not counting the one reading it) as 4
+        // read-only words, low word first. Reading the low word latches all
+        // four, so reading them in order gives one consistent 64-bit value.
+        static const USHORT IO_ICOUNT = 0xFFF0u;
+        
+        static const USHORT IO_KEYBOARD = 0xFFFCu; // Last key (INT_KEYSTROKE), read-only
+        static const USHORT IO_CONSOLE  = 0xFFFEu; // Character output
         
         static const int INT_INIT      = 0;
         static const int INT_TIMER     = 1;
         static const int INT_VIOLATION = 2;
         static const int INT_KEYSTROKE = 3;
         
+        // Interrupt polling (adaptive interval bounds, target time per poll):
+        static const size_t POLL_MIN       = 1u;
+        static const size_t POLL_MAX       = 65536u;
+        static const long   POLL_TARGET_US = 1000;
+        
         ProcessorState state;
         
         std::vector<unsigned char> mem;
@@ -93,11 +223,50 @@ namespace vm87 {
         size_t sec_addr[4];
         size_t sec_len[4];
         
+        // R/W/X permissions per byte, plus one (never accessible) entry past
+        // the end so that word checks need no wrap-around (see buildPermissions).
+        std::vector<unsigned char> perm;
+        
         bool irq[8];
         int  irq_hand;
         
+        // Host time and input are only checked every poll_interval retired
+        // instructions (adapted to ~POLL_TARGET_US unless poll_every != 0).
+        // With timer_every != 0 the timer is virtual: it fires every
+        // timer_every retired instructions instead of every 1000 ms.
+        size_t poll_every;
+        size_t timer_every;
+        size_t poll_interval;
+        unsigned long long next_poll;
+        unsigned long long next_timer;
+        TIME_POINT last_poll;
+        
+        InputThread * input; // Keyboard (nullptr - getch() on this thread)
+        bool use_getch;      // (false - no keyboard without input, no ncurses)
+        USHORT key_frame;    // SP while in the keystroke handler (0 - not in it)
+        USHORT key_latch;    // Last key delivered (read through IO_KEYBOARD)
+        
+        ConsoleOutput console; // IO_CONSOLE
+        
+        MmioRegistry devices; // I/O area (see attachDevice)
+        
+        PerfCounters counters;
+        
+        Fault fault; // Being handled or stopped the program (kind NONE - none)
+        
         bool debug;
         
+        bool init_done;                // INT_INIT called (false - on the next run)
+        unsigned long long stop_at;    // runProgram returns at this icount (0 - never)
+        
+        const InstructionDesc * decode; // Predecode table (see DecodeTable)
+        
+        Profile * profile; // Per-PC counters (nullptr - off, see VM87-Profile.hpp)
+        
+        CallGraph * callgraph; // Shadow call stack (nullptr - off, see VM87-CallGraph.hpp)
+        
+        std::FILE * trace; // Instruction trace (nullptr - off, see traceInstruction)
+        
         Runtime();
         
         size_t locateSections
@@ -110,50 +279,152 @@ namespace vm87 {
         
         void loadFromELF(const asem::ELFHolder & eh, bool cs);
         
+        void loadFromImage(const ProgramImage & img); // See VM87-Image.hpp
+        
+        // Whole section at once (records sorted by offset, values by ordinal):
+        void applyRelocations
+            ( const std::vector<asem::RelocRecord> & rrs
+            , const std::vector<int> & symvals
+            ) ;
+        
         void runProgram(bool do_debug);
         
-        void fetchInstruction(InstructionDesc & desc, USHORT & data);
+        // (runProgram after INT_INIT, Policy - RunPolicy picked by runProgram)
+        template <class Policy>
+        void runLoop(TIME_POINT & tp);
         
-        void executeInstruction(const InstructionDesc & desc, USHORT data);
+        // Helpers below return false on a fault (in fault, nullptr for fetch):
         
-        void manageInterrupts(TIME_POINT & tp);
+        const InstructionDesc * fetchInstruction(USHORT & data);
+        
+        bool executeInstruction(const InstructionDesc & desc, USHORT data);
+        
+        bool manageInterrupts(TIME_POINT & tp);
+        
+        unsigned long long nextEvent() const; // icount of the next poll / timer / interrupt
         
         // Printing:
         
-        void printState() const;
+        void printState();
         
-        void printInstrDesc(const InstructionDesc & desc, USHORT data) const;
+        void printInstrDesc(const InstructionDesc & desc, USHORT data);
+        
+        // "icount PC: opcode pred dst_am src_am data | r0 .. r6 psw" to trace
+        void traceInstruction(USHORT pc, const InstructionDesc & desc, USHORT data);
         
         // Execute helpers:
         
-        bool callInterrupt(int ordinal);
+        bool callInterrupt(int ordinal); // (false - no handler or a fault)
         
-        void accessAddress(USHORT address, int action) const;
+        void raiseInterrupt(int ordinal) { // (Handled by manageInterrupts)
+            irq[ordinal] = true;
+            counters.irq_raised[ordinal] += 1;
+        }
         
-        short loadValueSigned(const InstructionDesc & desc, USHORT data, bool place);
+        bool trapViolation(); // (On a fault, false - unhandled, fault kept)
         
-        USHORT loadValueUnsigned(const InstructionDesc & desc, USHORT data, bool place);
+        bool setFault(unsigned char kind, USHORT address) { // (Always false)
+            fault.kind    = kind;
+            fault.address = address;
+            return false;
+        }
         
-        void storeValueSigned(const InstructionDesc & desc, USHORT data, short value);
+        void throwFault() const; // ViolationError for the pending fault
         
-        void storeValueUnsigned(const InstructionDesc & desc, USHORT data, USHORT value);
+        void buildPermissions();
         
-        USHORT memLoad(USHORT address);
+        // Adds a device to the I/O area (permissions are rebuilt):
+        void attachDevice(const MmioDevice & dev);
         
-        void memStore(USHORT address, USHORT value);
+        bool accessAddress(USHORT address, int action);
         
-        void setFlags
-            ( const InstructionDesc & desc
-            , short dst_s
-            , short src_s
-            , short res_s
-            , USHORT dst_u
-            , USHORT src_u
-            , USHORT res_u
-            ) ;
+        bool accessWord(USHORT address, int action);
+        
+        bool accessViolation(USHORT address, int action);
+        
+        bool memLoad(USHORT address, USHORT & value);
+        
+        bool memStore(USHORT address, USHORT value);
+        
+        // Not plain memory (devices) or a violation:
+        bool memLoadSlow(USHORT address, USHORT & value);
+        
+        bool memStoreSlow(USHORT address, USHORT value);
         
     };
     
+    ////////////////////////////////////////////////////////////////////////////
+    
+    // Memory checks and accesses (the most common operations, hence inline):
+    
+    inline
+    bool Runtime::accessAddress(USHORT address, int action) {
+        
+        if ((perm[address] & (1u << action)) == 0)
+            return accessViolation(address, action);
+        
+        return true;
+        
+    }
+    
+    // Both bytes of a word with a single lookup.
+    inline
+    bool Runtime::accessWord(USHORT address, int action) {
+        
+        const unsigned mask = (0x0101u << action);
+        
+        USHORT bits;
+        
+        std::memcpy(&bits, &perm[address], sizeof(USHORT));
+        
+        if ((bits & mask) != mask)
+            return accessViolation(address, action);
+        
+        return true;
+        
+    }
+    
+    // Plain memory (both bytes readable, neither hooked by a device):
+    inline
+    bool Runtime::memLoad(USHORT address, USHORT & value) {
+        
+        const unsigned mask = (0x0101u << READ);
+        
+        USHORT bits;
+        
+        std::memcpy(&bits, &perm[address], sizeof(USHORT));
+        
+        if ((bits & (mask | (mask << 3))) != mask)
+            return memLoadSlow(address, value);
+            
+        counters.loads += 1;
+        
+        std::memcpy(&value, &mem[address], sizeof(USHORT));
+        
+        return true;
+        
+    }
+    
+    inline
+    bool Runtime::memStore(USHORT address, USHORT value) {
+        
+        const unsigned mask = (0x0101u << WRITE);
+        
+        USHORT bits;
+        
+        std::memcpy(&bits, &perm[address], sizeof(USHORT));
+        
+        if ((bits & (mask | (mask << 3))) != mask)
+            return memStoreSlow(address, value);
+            
+        counters.stores += 1;
+        
+        std::memcpy(&mem[address], &value, sizeof(USHORT));
+        
+        return true;
+        
+    }
+    
 }
 
 #endif /* ASEM_RUNTIME_HPP */
@@ -0,0 +1,152 @@
+
+#include "VM87-Snapshot.hpp"
+
+#include <fstream>
+#include <string>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace vm87 {
+    
+    static_assert(sizeof(SnapshotHeader) == 88u, "SnapshotHeader must be packed.");
+    
+    void SaveSnapshot(const Runtime & rt, std::vector<unsigned char> & buf) {
+        
+        SnapshotHeader hdr{};
+        
+        std::memcpy(hdr.magic, SNAPSHOT_MAGIC, 4);
+        
+        hdr.version    = SNAPSHOT_VERSION;
+        hdr.psw        = rt.state.getPSW(); // (With pending flags)
+        hdr.icount     = rt.state.icount;
+        hdr.next_timer = rt.next_timer;
+        hdr.irq_hand   = rt.irq_hand;
+        hdr.key_frame  = rt.key_frame;
+        hdr.key_latch  = rt.key_latch;
+        hdr.init_done  = rt.init_done ? 1u : 0u;
+        
+        for (size_t i = 0; i < 8; i += 1) {
+            hdr.regs[i] = rt.state.regs[i];
+            if (rt.irq[i]) hdr.irq |= std::uint8_t(1u << i);
+        }
+        
+        for (size_t i = 0; i < 4; i += 1) {
+            hdr.sec_addr[i] = std::uint32_t(rt.sec_addr[i]);
+            hdr.sec_len [i] = std::uint32_t(rt.sec_len [i]);
+        }
+        
+        buf.resize(SNAPSHOT_SIZE);
+        
+        std::memcpy( &buf[0], &hdr, sizeof(hdr) );
+        std::memcpy( &buf[sizeof(hdr)], &(rt.mem[0]), SNAPSHOT_MEM );
+        
+    }
+    
+    void RestoreSnapshot(Runtime & rt, const unsigned char * data, size_t size) {
+        
+        SnapshotHeader hdr;
+        
+        if (size < sizeof(hdr))
+            throw LoadError("Snapshot has a wrong size.");
+            
+        std::memcpy( &hdr, data, sizeof(hdr) );
+        
+        if (std::memcmp(hdr.magic, SNAPSHOT_MAGIC, 4) != 0)
+            throw LoadError("Not a snapshot.");
+            
+        if (hdr.version != SNAPSHOT_VERSION)
+            throw LoadError("Unsupported snapshot version.");
+            
+        if (size != SNAPSHOT_SIZE)
+            throw LoadError("Snapshot has a wrong size.");
+            
+        for (size_t i = 0; i < 4; i += 1)
+            if (std::uint64_t(hdr.sec_addr[i]) + hdr.sec_len[i] > SNAPSHOT_MEM)
+                throw LoadError("Snapshot section exceeds memory boundaries.");
+                
+        std::memcpy( &(rt.mem[0]), data + sizeof(hdr), SNAPSHOT_MEM );
+        
+        for (size_t i = 0; i < 8; i += 1) {
+            rt.state.regs[i] = hdr.regs[i];
+            rt.irq[i]        = ((hdr.irq & (1u << i)) != 0);
+        }
+        
+        for (size_t i = 0; i < 4; i += 1) {
+            rt.sec_addr[i] = hdr.sec_addr[i];
+            rt.sec_len [i] = hdr.sec_len [i];
+        }
+        
+        rt.state.setPSW(hdr.psw);
+        
+        rt.state.icount = hdr.icount;
+        rt.next_timer   = hdr.next_timer;
+        rt.next_poll    = hdr.icount; // Poll right away
+        rt.irq_hand     = hdr.irq_hand;
+        rt.key_frame    = hdr.key_frame;
+        rt.key_latch    = hdr.key_latch;
+        rt.init_done    = (hdr.init_done != 0);
+        
+        rt.buildPermissions();
+        
+    }
+    
+    void SaveSnapshot(const Runtime & rt, const char * path) {
+        
+        std::vector<unsigned char> buf;
+        
+        SaveSnapshot(rt, buf);
+        
+        std::ofstream file{path, std::ios::binary};
+        
+        if (!file.is_open())
+            throw UnrecError(std::string{"Could not open file ["} + path + "] for writing.");
+            
+        file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+        
+        if (!file)
+            throw UnrecError(std::string{"Could not write snapshot ["} + path + "].");
+            
+    }
+    
+    void RestoreSnapshot(Runtime & rt, const char * path) {
+        
+        std::vector<unsigned char> buf(SNAPSHOT_SIZE + 1u);
+        
+        int fd = open(path, O_RDONLY);
+        
+        if (fd < 0)
+            throw LoadError(std::string{"Could not open snapshot ["} + path + "] for reading.");
+            
+        // (One byte more than needed to catch longer files)
+        size_t got = 0;
+        ssize_t cnt;
+        
+        while (got < buf.size() && (cnt = read(fd, &buf[got], buf.size() - got)) > 0)
+            got += size_t(cnt);
+            
+        close(fd);
+        
+        RestoreSnapshot(rt, buf.data(), got);
+        
+    }
+    
+    bool IsSnapshot(const char * path) {
+        
+        char magic[4];
+        
+        int fd = open(path, O_RDONLY);
+        
+        if (fd < 0) return false;
+        
+        bool rv = (read(fd, magic, 4) == 4 && std::memcmp(magic, SNAPSHOT_MAGIC, 4) == 0);
+        
+        close(fd);
+        
+        return rv;
+        
+    }
+    
+}
+
@@ -0,0 +1,60 @@
+
+#ifndef VM87_SNAPSHOT_HPP
+#define VM87_SNAPSHOT_HPP
+
+#include "VM87-Runtime.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vm87 {
+    
+    // Snapshot of a loaded (and possibly already running) Runtime: memory,
+    // registers, PSW, retired instruction count, section layout, pending
+    // interrupts, the last key delivered and the virtual timer. Restoring one
+    // into a fresh Runtime continues exactly where the snapshot was taken
+    // (INT_INIT is not called again once it was). Host-side state (console
+    // buffer, keyboard queue, wall clock) is not part of it.
+    //
+    // Layout: SnapshotHeader followed by the whole memory (SNAPSHOT_MEM bytes).
+    
+    struct SnapshotHeader {
+        
+        char          magic[4];    // SNAPSHOT_MAGIC
+        std::uint16_t version;     // SNAPSHOT_VERSION
+        std::uint16_t psw;
+        std::uint16_t regs[8];
+        std::uint64_t icount;
+        std::uint64_t next_timer;  // (Virtual timer)
+        std::uint32_t sec_addr[4];
+        std::uint32_t sec_len[4];
+        std::int32_t  irq_hand;
+        std::uint16_t key_frame;
+        std::uint16_t key_latch;   // (Keyboard device)
+        std::uint8_t  irq;         // Bit i - irq[i]
+        std::uint8_t  init_done;
+        std::uint8_t  reserved[4]; // (Zero)
+        
+    };
+    
+    static const char          SNAPSHOT_MAGIC[4] = {'V', '8', '7', 'S'};
+    static const std::uint16_t SNAPSHOT_VERSION  = 2u;
+    static const size_t        SNAPSHOT_MEM      = 65536u;
+    static const size_t        SNAPSHOT_SIZE     = sizeof(SnapshotHeader) + SNAPSHOT_MEM;
+    
+    // In memory (Restore throws LoadError on a malformed buffer):
+    void SaveSnapshot(const Runtime & rt, std::vector<unsigned char> & buf);
+    void RestoreSnapshot(Runtime & rt, const unsigned char * data, size_t size);
+    
+    // Files (throw UnrecError / LoadError):
+    void SaveSnapshot(const Runtime & rt, const char * path);
+    void RestoreSnapshot(Runtime & rt, const char * path);
+    
+    // Does the file start with SNAPSHOT_MAGIC?
+    bool IsSnapshot(const char * path);
+    
+}
+
+#endif /* VM87_SNAPSHOT_HPP */
+
@@ -0,0 +1,226 @@
+
+#include "VM87-SymIndex.hpp"
+#include "VM87-Image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+using namespace asem;
+
+namespace vm87 {
+    
+    const std::uint32_t SymbolIndex::NONE;
+    
+    // Section of a section symbol (Section::Undefined for other names):
+    static
+    Section::Enum SectionSymbol(const char * name) {
+        
+        if (name[0] != '.') return Section::Undefined;
+        
+        if (std::strcmp(name, ".text")   == 0) return Section::Text;
+        if (std::strcmp(name, ".data")   == 0) return Section::Data;
+        if (std::strcmp(name, ".rodata") == 0) return Section::ROData;
+        if (std::strcmp(name, ".bss")    == 0) return Section::BSS;
+        
+        return Section::Undefined;
+        
+    }
+    
+    void SymbolIndex::clear() {
+        
+        items.clear();
+        names.clear();
+        cands.clear();
+        
+    }
+    
+    void SymbolIndex::add(const char * name, int value, int section, bool defined,
+                          size_t ordinal, const int base[4], const Runtime & rt) {
+                          
+        if (!defined || section < 0 || section > 3) return;
+        
+        if (rt.sec_len[section] == 0) return; // (Not loaded)
+        
+        // Symbol values are addresses as assembled; rebase them onto the
+        // section's load address:
+        long addr = long(rt.sec_addr[section]) + (long(value) - long(base[section]));
+        
+        if (addr < long(rt.sec_addr[section]) ||
+            addr >= long(rt.sec_addr[section] + rt.sec_len[section])) return;
+            
+        Candidate c;
+        
+        c.addr       = std::uint32_t(addr);
+        c.ordinal    = std::uint32_t(ordinal);
+        c.name       = std::uint32_t(names.size());
+        c.section    = section;
+        c.is_section = (SectionSymbol(name) != Section::Undefined);
+        
+        names.insert(names.end(), name, name + std::strlen(name) + 1u);
+        
+        cands.push_back(c);
+        
+    }
+    
+    void SymbolIndex::finish(const Runtime & rt) {
+        
+        std::sort(cands.begin(), cands.end(), [](const Candidate & a, const Candidate & b) {
+            if (a.addr != b.addr) return a.addr < b.addr;
+            if (a.is_section != b.is_section) return b.is_section;
+            return a.ordinal < b.ordinal;
+        });
+        
+        items.reserve(cands.size());
+        
+        for (size_t i = 0; i < cands.size(); i += 1) {
+            
+            const Candidate & c = cands[i];
+            
+            if (!items.empty() && items.back().start == c.addr) continue; // (Aliases)
+            
+            std::uint32_t end = std::uint32_t(rt.sec_addr[c.section] + rt.sec_len[c.section]);
+            
+            // Next distinct address (sections don't overlap):
+            size_t t = i + 1;
+            while (t < cands.size() && cands[t].addr == c.addr) t += 1;
+            
+            if (t < cands.size() && cands[t].addr < end) end = cands[t].addr;
+            
+            Interval iv;
+            
+            iv.start   = c.addr;
+            iv.end     = end;
+            iv.name    = c.name;
+            iv.section = c.section;
+            
+            items.push_back(iv);
+            
+        }
+        
+        cands.clear();
+        cands.shrink_to_fit();
+        
+    }
+    
+    void SymbolIndex::build(const SymbolTable & st, const Runtime & rt) {
+        
+        clear();
+        
+        const SymbolStore & symbols = st.data;
+        
+        int base[4] = {0, 0, 0, 0};
+        
+        for (size_t i = 0; i < symbols.ordinals(); i += 1) {
+            
+            if (!symbols.has(i)) continue;
+            
+            Section::Enum sec = SectionSymbol(symbols.name(i));
+            
+            if (sec != Section::Undefined) base[sec] = symbols.entry(i).value;
+            
+        }
+        
+        cands.reserve(symbols.size());
+        
+        for (size_t i = 0; i < symbols.ordinals(); i += 1) {
+            
+            if (!symbols.has(i)) continue;
+            
+            const SymbolTableEntry & e = symbols.entry(i);
+            
+            add(symbols.name(i), e.value, int(e.section), e.defined, i, base, rt);
+            
+        }
+        
+        finish(rt);
+        
+    }
+    
+    void SymbolIndex::build(const ProgramImage & img, const Runtime & rt) {
+        
+        clear();
+        
+        const ImageSymbol * sym = img.symbols();
+        size_t              cnt = img.header().sym_cnt;
+        
+        int base[4] = {0, 0, 0, 0};
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            Section::Enum sec = SectionSymbol(img.symbolName(sym[i]));
+            
+            if (sec != Section::Undefined) base[sec] = sym[i].value;
+            
+        }
+        
+        cands.reserve(cnt);
+        
+        for (size_t i = 0; i < cnt; i += 1) {
+            
+            add(img.symbolName(sym[i]), sym[i].value, int(sym[i].section),
+                sym[i].defined != 0, i, base, rt);
+                
+        }
+        
+        finish(rt);
+        
+    }
+    
+    std::uint32_t SymbolIndex::find(size_t addr) const {
+        
+        // First interval starting after addr, then step back:
+        auto it = std::upper_bound(items.begin(), items.end(), addr,
+            [](size_t a, const Interval & iv) { return a < iv.start; });
+            
+        if (it == items.begin()) return NONE;
+        
+        --it;
+        
+        return (addr < it->end) ? std::uint32_t(it - items.begin()) : NONE;
+        
+    }
+    
+    void SymbolIndex::find(const USHORT * addrs, size_t n, std::uint32_t * out) const {
+        
+        std::uint32_t last = NONE;
+        
+        for (size_t i = 0; i < n; i += 1) {
+            
+            size_t addr = addrs[i];
+            
+            if (last != NONE && addr >= items[last].start && addr < items[last].end) {
+                out[i] = last;
+                continue;
+            }
+            
+            out[i] = last = find(addr);
+            
+        }
+        
+    }
+    
+    std::string SymbolIndex::describe(size_t addr) const {
+        
+        char buffer[32];
+        
+        std::uint32_t i = find(addr);
+        
+        if (i == NONE) {
+            std::snprintf(buffer, sizeof(buffer), "0x%04X", unsigned(addr));
+            return std::string{buffer};
+        }
+        
+        std::string rv{name(items[i])};
+        
+        if (addr != items[i].start) {
+            std::snprintf(buffer, sizeof(buffer), "+0x%X", unsigned(addr - items[i].start));
+            rv += buffer;
+        }
+        
+        return rv;
+        
+    }
+    
+}
+
@@ -0,0 +1,89 @@
+
+#ifndef VM87_SYMINDEX_HPP
+#define VM87_SYMINDEX_HPP
+
+#include "VM87-Runtime.hpp"
+#include "Asem-SymTab.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace vm87 {
+    
+    // Address to symbol + offset (for profiles, traces and crash reports).
+    // Built from the symbol table of a loaded program and the section bases
+    // the loader picked (Runtime::sec_addr): a symbol defined in a loaded
+    // section covers the addresses from its own up to the next symbol's (or
+    // the end of its section). Section symbols (.text, ...) only cover what
+    // precedes the first other symbol of their section. Intervals are kept
+    // sorted by address, so a lookup is a binary search.
+    class SymbolIndex {
+    
+    public:
+        
+        static const std::uint32_t NONE = 0xFFFFFFFFu;
+        
+        struct Interval {
+            
+            std::uint32_t start;   // Absolute address
+            std::uint32_t end;     // (Exclusive)
+            std::uint32_t name;    // Offset in the name arena
+            std::int32_t  section; // asem::Section::Enum
+            
+        };
+        
+        void clear();
+        
+        // (rt must already be loaded from the same program)
+        void build(const asem::SymbolTable & st, const Runtime & rt);
+        
+        void build(const ProgramImage & img, const Runtime & rt);
+        
+        bool empty() const { return items.empty(); }
+        
+        size_t size() const { return items.size(); }
+        
+        const Interval & at(size_t i) const { return items[i]; }
+        
+        const char * name(const Interval & iv) const { return &names[iv.name]; }
+        
+        // Index of the interval containing addr (NONE if there is none):
+        std::uint32_t find(size_t addr) const;
+        
+        // out[i] = find(addrs[i]). Reuses the last interval while it still
+        // contains the next address, so sorted or clustered inputs (traces,
+        // per-PC arrays) mostly skip the search.
+        void find(const USHORT * addrs, size_t n, std::uint32_t * out) const;
+        
+        // "name+0x1A" ("name" at offset 0, "0x1234" if nothing covers addr):
+        std::string describe(size_t addr) const;
+        
+    private:
+        
+        struct Candidate {
+            
+            std::uint32_t addr;
+            std::uint32_t ordinal;
+            std::uint32_t name;
+            std::int32_t  section;
+            bool          is_section; // Section symbol (lower priority)
+            
+        };
+        
+        std::vector<Interval> items;
+        std::vector<char>     names;
+        std::vector<Candidate> cands; // (Only while building)
+        
+        void add(const char * name, int value, int section, bool defined,
+                 size_t ordinal, const int base[4], const Runtime & rt);
+                 
+        void finish(const Runtime & rt);
+        
+    };
+    
+}
+
+#endif /* VM87_SYMINDEX_HPP */
+
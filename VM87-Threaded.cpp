@@ -0,0 +1,483 @@
+
+#include "VM87-Threaded.hpp"
+#include "VM87-Runtime.hpp"
+#include "VM87-FuncRT.hpp"
+#include "Asem-Enumeration.hpp"
+#include "Asem-Func.hpp"
+
+#include <cstdio>
+
+using namespace asem;
+
+// Superinstructions, as X2(id, name, part, part) or X3(id, name, part, part,
+// part), each part as (handler, opcode, dst_am, src_am). Addressing modes of
+// an unused operand don't matter (the parts are matched on the used ones), and
+// register numbers are taken from the operations. Longer sequences go first.
+#define VM87_FUSIONS(X2, X3)                                                                \
+    X3(PUSH2_CALL, "push r ; push r ; call #i", (ExecPush, Push, REG, REG)                  \
+                                              , (ExecPush, Push, REG, REG)                  \
+                                              , (ExecCall, Call, REG, IMM))                 \
+    X3(POP2_IRET,  "pop r ; pop r ; iret",      (ExecPop,  Pop,  REG, REG)                  \
+                                              , (ExecPop,  Pop,  REG, REG)                  \
+                                              , (ExecIret, Iret, REG, REG))                 \
+    X2(CMP_RR_MOV, "cmp r, r ; mov r, #i",      (ExecCmp,  Cmp,  REG, REG)                  \
+                                              , (ExecMov,  Mov,  REG, IMM))                 \
+    X2(CMP_RI_MOV, "cmp r, #i ; mov r, #i",     (ExecCmp,  Cmp,  REG, IMM)                  \
+                                              , (ExecMov,  Mov,  REG, IMM))                 \
+    X2(CMP_RR_ADD, "cmp r, r ; add r, #i",      (ExecCmp,  Cmp,  REG, REG)                  \
+                                              , (ExecAdd,  Add,  REG, IMM))                 \
+    X2(CMP_RI_ADD, "cmp r, #i ; add r, #i",     (ExecCmp,  Cmp,  REG, IMM)                  \
+                                              , (ExecAdd,  Add,  REG, IMM))                 \
+    X2(TEST_RI_MOV, "test r, #i ; mov r, #i",   (ExecTest, Test, REG, IMM)                  \
+                                              , (ExecMov,  Mov,  REG, IMM))                 \
+    X2(SUB_RI_MOV, "sub r, #i ; mov r, #i",     (ExecSub,  Sub,  REG, IMM)                  \
+                                              , (ExecMov,  Mov,  REG, IMM))                 \
+    X2(PUSH_CALL,  "push r ; call #i",          (ExecPush, Push, REG, REG)                  \
+                                              , (ExecCall, Call, REG, IMM))                 \
+    X2(POP_IRET,   "pop r ; iret",              (ExecPop,  Pop,  REG, REG)                  \
+                                              , (ExecIret, Iret, REG, REG))                 \
+    X2(POP2,       "pop r ; pop r",             (ExecPop,  Pop,  REG, REG)                  \
+                                              , (ExecPop,  Pop,  REG, REG))
+
+namespace vm87 {
+    
+    static const unsigned IMM = AddrMode::Imm;
+    static const unsigned REG = AddrMode::RegDir;
+    
+    struct FusionPart {
+        
+        unsigned id;     // asem::Command::Enum
+        unsigned dst_am;
+        unsigned src_am;
+        
+        bool matches(const InstructionDesc & desc) const {
+            
+            bool dst, src;
+            
+            InstructionOperands(desc.getId(), dst, src);
+            
+            return desc.id == id &&
+                   (!dst || desc.dst_am == dst_am) &&
+                   (!src || desc.src_am == src_am);
+                   
+        }
+        
+    };
+    
+    struct Fusion {
+        
+        const char * name;
+        unsigned     length;
+        FusionPart   parts[3];
+        
+    };
+    
+#define FUSION_PART(func, opcode, dst, src) { Command::opcode, dst, src }
+#define FUSION_2(id, name, a, b)    { name, 2u, { FUSION_PART a, FUSION_PART b, { 0u, 0u, 0u } } },
+#define FUSION_3(id, name, a, b, c) { name, 3u, { FUSION_PART a, FUSION_PART b, FUSION_PART c } },
+#define FUSION_ID(id, ...) F_##id,
+    
+    static const Fusion FUSIONS[] = { VM87_FUSIONS(FUSION_2, FUSION_3) };
+    
+    enum FusionId { VM87_FUSIONS(FUSION_ID, FUSION_ID) FUSION_COUNT };
+    
+#undef FUSION_ID
+#undef FUSION_3
+#undef FUSION_2
+#undef FUSION_PART
+    
+    // Could the instruction change PC or PSW (which ends a basic block)?
+    static bool EndsBlock(const InstructionDesc & desc) {
+        
+        switch (desc.getId()) {
+            
+            case Command::Call:
+            case Command::Iret:
+                return true;
+                
+            case Command::Cmp:
+            case Command::Test:
+            case Command::Push:
+                return false;
+                
+            default:
+                break;
+                
+        }
+        
+        if (desc.dst_reg_no != Runtime::PC) return false;
+        
+        return (desc.getDstAM() == AddrMode::RegDir || // pc
+                desc.getDstAM() == AddrMode::Imm);     // psw
+                
+    }
+    
+    ThreadedEngine::ThreadedEngine(Runtime & rt, bool use_jit, bool use_fusion)
+        : rt(rt)
+        , jit(rt)
+        , jit_enabled(use_jit && JitCompiler::Supported()) {
+        
+        translate();
+        
+        fusion_sites.assign(FUSION_COUNT, 0u);
+        fusion_hits .assign(FUSION_COUNT, 0u);
+        
+        if (use_fusion) fuse(dispatch(nullptr));
+        
+        if (jit_enabled) {
+            jit_code.assign(text_len, nullptr);
+            jit_hits.assign(text_len, 0u);
+        }
+        
+    }
+    
+    void ThreadedEngine::translate() {
+        
+        const void * const * labels = dispatch(nullptr);
+        
+        text_addr = rt.sec_addr[Section::Text];
+        text_len  = rt.sec_len [Section::Text];
+        block_cnt = 0;
+        
+        ops.assign(text_len, Op{nullptr, nullptr, nullptr, 0u, 0u});
+        
+        // Decode every (byte) offset - a jump may land anywhere:
+        for (size_t i = 0; i < text_len; i += 1) {
+            
+            Op & op = ops[i];
+            
+            if (i + 2u > text_len) continue;
+            
+            USHORT encoded = USHORT(rt.mem[text_addr + i]) |
+                             USHORT(rt.mem[text_addr + i + 1u] << 8);
+                             
+            op.desc    = &rt.decode[encoded];
+            op.next_pc = USHORT(text_addr + i + 2u);
+            
+            if (op.desc->has_data) {
+                
+                if (i + 4u > text_len) continue;
+                
+                op.data = USHORT(rt.mem[text_addr + i + 2u]) |
+                          USHORT(rt.mem[text_addr + i + 3u] << 8);
+                op.next_pc += 2u;
+                
+            }
+            
+            op.handler = labels[op.desc->handler];
+            
+        }
+        
+        // Chain fall-through successors into basic blocks:
+        for (size_t i = 0; i < text_len; i += 1) {
+            
+            Op & op = ops[i];
+            
+            if (op.handler == nullptr) continue;
+            
+            Op * next = lookup(op.next_pc);
+            
+            if (EndsBlock(*op.desc) || next == nullptr)
+                block_cnt += 1;
+            else
+                op.next = next;
+                
+        }
+        
+    }
+    
+    void ThreadedEngine::fuse(const void * const * labels) {
+        
+        // (Superinstruction labels follow the handler labels)
+        for (size_t i = 0; i < text_len; i += 1) {
+            
+            Op & op = ops[i];
+            
+            if (op.handler == nullptr) continue;
+            
+            for (unsigned f = 0; f < FUSION_COUNT; f += 1) {
+                
+                const Fusion & fusion = FUSIONS[f];
+                
+                const Op * part = &op;
+                unsigned   cnt  = 0;
+                
+                while (cnt < fusion.length && part != nullptr &&
+                       fusion.parts[cnt].matches(*part->desc)) {
+                    part = part->next;
+                    cnt += 1;
+                }
+                
+                if (cnt != fusion.length) continue;
+                
+                op.handler = labels[EXEC_HANDLER_COUNT + f];
+                
+                fusion_sites[f] += 1;
+                
+                break;
+                
+            }
+            
+        }
+        
+    }
+    
+    std::string ThreadedEngine::fusionReport() const {
+        
+        std::string rv;
+        
+        char buffer[160];
+        
+        for (unsigned f = 0; f < FUSION_COUNT; f += 1) {
+            
+            if (fusion_sites[f] == 0) continue;
+            
+            std::snprintf(buffer, sizeof(buffer), "fusion %-30s %6zu sites %15llu executed\n"
+                         , FUSIONS[f].name, fusion_sites[f], fusion_hits[f]);
+                         
+            rv += buffer;
+            
+        }
+        
+        return rv;
+        
+    }
+    
+    ThreadedEngine::Op * ThreadedEngine::lookup(USHORT pc) {
+        
+        size_t off = size_t(pc) - text_addr;
+        
+        if (pc < text_addr || off >= text_len) return nullptr;
+        
+        Op * op = &ops[off];
+        
+        return (op->handler != nullptr) ? op : nullptr;
+        
+    }
+    
+    // Runs (compiling it first, once hot) the native block at pc - returns
+    // false if there is none or it didn't make any progress.
+    bool ThreadedEngine::runNative(USHORT pc) {
+        
+        size_t off = size_t(pc) - text_addr;
+        
+        JitCompiler::BlockFunc fn = jit_code[off];
+        
+        if (fn == nullptr) {
+            
+            if (jit_hits[off] >= VM87_JIT_THRESHOLD) return false;
+            
+            jit_hits[off] += 1;
+            
+            if (jit_hits[off] < VM87_JIT_THRESHOLD) return false;
+            
+            fn = jit_code[off] = jit.compile(pc);
+            
+            if (fn == nullptr) return false;
+            
+        }
+        
+        rt.state.syncFlags(); // Native code works on psw directly
+        
+        unsigned long long icount = rt.state.icount;
+        
+        fn(&rt.state, rt.mem.data(), rt.nextEvent());
+        
+        // The block exits before an instruction it can't handle, which could
+        // be the first one:
+        return (rt.state.icount != icount);
+        
+    }
+    
+    void ThreadedEngine::step() {
+        
+        // Same as one iteration of the reference engine (a fetch outside of
+        // .text raises an unhandled violation, just like it does there).
+        
+        USHORT data = 0;
+        
+        const InstructionDesc * desc = rt.fetchInstruction(data);
+        
+        if (desc == nullptr) rt.throwFault();
+        
+        bool executed = rt.executeInstruction(*desc, data);
+        
+        rt.state.icount += 1;
+        
+        if (!executed && !rt.trapViolation()) rt.throwFault();
+        
+    }
+    
+    void ThreadedEngine::runProgram() {
+        
+        rt.debug = false;
+        
+        rt.fault.kind = Fault::NONE;
+        
+        TIME_POINT tp = CLOCK::now();
+        
+        if (!rt.init_done) {
+            rt.init_done = true;
+            rt.counters.irq_raised[Runtime::INT_INIT] += 1;
+            if (!rt.callInterrupt(Runtime::INT_INIT) && rt.fault.pending()) rt.throwFault();
+        }
+        
+        while (true) {
+            
+            Op * op = lookup(rt.state.regs[Runtime::PC]);
+            
+            if (op != nullptr && jit_enabled && runNative(rt.state.regs[Runtime::PC])) {
+                
+                // Native block done
+                
+            } else if (op == nullptr) {
+                
+                step();
+                
+            } else {
+                
+                // (Leaves the block at a fault)
+                dispatch(op);
+                
+                if (rt.fault.pending() && !rt.trapViolation()) rt.throwFault();
+                
+            }
+            
+            // INTERRUPTS:
+            if (!rt.manageInterrupts(tp)) rt.throwFault();
+            
+            // END OF PROGRAM (if psw & (1 << 10) != 0):
+            if ( (rt.state.psw & USHORT(1 << 10)) != 0 ) break;
+            
+        }
+        
+    }
+
+// (Counted after the handler, as in Runtime::runLoop - see IO_ICOUNT)
+#define STEP(func, dst, src)                                                    \
+        regs[Runtime::PC] = op->next_pc;                                        \
+        if (op->desc->pred == Predicate::Al ||                                  \
+            CheckPredicate(rt.state, op->desc->pred)) {                         \
+            if (!func<dst, src>(rt, *op->desc, op->data)) {                     \
+                rt.state.icount += 1;                                           \
+                return nullptr;                                                 \
+            }                                                                   \
+        } else {                                                                \
+            rt.counters.skipped += 1;                                           \
+        }                                                                       \
+        rt.state.icount += 1;
+
+// (Leaves the block at the next event, like the reference engine would)
+#define NEXT                                                                    \
+        if ((op = op->next) == nullptr || --budget <= 0) return nullptr;        \
+        goto *op->handler;
+
+#define HANDLER(label, func, dst, src)                                          \
+    label##_##dst##src:                                                         \
+        STEP(func, dst, src)                                                    \
+        NEXT
+
+// One handler per (dst, src) addressing mode (see EXEC_HANDLERS):
+#define HANDLERS_AM(label, func, dst)                                           \
+    HANDLER(label, func, dst, 0)                                                \
+    HANDLER(label, func, dst, 1)                                                \
+    HANDLER(label, func, dst, 2)                                                \
+    HANDLER(label, func, dst, 3)
+
+#define HANDLERS(label, func)                                                   \
+    HANDLERS_AM(label, func, 0)                                                 \
+    HANDLERS_AM(label, func, 1)                                                 \
+    HANDLERS_AM(label, func, 2)                                                 \
+    HANDLERS_AM(label, func, 3)
+
+#define LABELS_AM(label, dst)                                                   \
+    &&label##_##dst##0, &&label##_##dst##1, &&label##_##dst##2, &&label##_##dst##3
+
+#define LABELS(label)                                                           \
+    LABELS_AM(label, 0), LABELS_AM(label, 1), LABELS_AM(label, 2), LABELS_AM(label, 3)
+
+// Superinstructions (the parts are the operations chained to the first one):
+#define FUSED_STEP(func, opcode, dst, src) STEP(func, dst, src)
+
+#define FUSED_NEXT                                                              \
+        if (--budget <= 0) return nullptr;                                      \
+        op = op->next;
+
+#define FUSED_2(id, name, a, b)                                                 \
+    L_F_##id:                                                                   \
+        fusion_hits[F_##id] += 1;                                               \
+        FUSED_STEP a                                                            \
+        FUSED_NEXT                                                              \
+        FUSED_STEP b                                                            \
+        NEXT
+
+#define FUSED_3(id, name, a, b, c)                                              \
+    L_F_##id:                                                                   \
+        fusion_hits[F_##id] += 1;                                               \
+        FUSED_STEP a                                                            \
+        FUSED_NEXT                                                              \
+        FUSED_STEP b                                                            \
+        FUSED_NEXT                                                              \
+        FUSED_STEP c                                                            \
+        NEXT
+
+#define FUSED_LABEL(id, ...) &&L_F_##id,
+        
+    const void * const * ThreadedEngine::dispatch(Op * op) {
+        
+        // Indexed by InstructionDesc::handler (same order as EXEC_HANDLERS),
+        // then by superinstruction:
+        static const void * const labels[EXEC_HANDLER_COUNT + FUSION_COUNT] =
+            { LABELS(L_ADD),  LABELS(L_SUB),  LABELS(L_MUL),  LABELS(L_DIV)
+            , LABELS(L_CMP),  LABELS(L_AND),  LABELS(L_OR),   LABELS(L_NOT)
+            , LABELS(L_TEST), LABELS(L_PUSH), LABELS(L_POP),  LABELS(L_CALL)
+            , LABELS(L_IRET), LABELS(L_MOV),  LABELS(L_SHL),  LABELS(L_SHR)
+            , VM87_FUSIONS(FUSED_LABEL, FUSED_LABEL)
+            } ;
+            
+        if (op == nullptr) return labels;
+        
+        USHORT * regs = rt.state.regs;
+        
+        // Instructions left until the next event (at least one is run):
+        long long budget = static_cast<long long>(rt.nextEvent() - rt.state.icount);
+        
+        goto *op->handler;
+        
+        HANDLERS(L_ADD,  ExecAdd)
+        HANDLERS(L_SUB,  ExecSub)
+        HANDLERS(L_MUL,  ExecMul)
+        HANDLERS(L_DIV,  ExecDiv)
+        HANDLERS(L_CMP,  ExecCmp)
+        HANDLERS(L_AND,  ExecAnd)
+        HANDLERS(L_OR,   ExecOr)
+        HANDLERS(L_NOT,  ExecNot)
+        HANDLERS(L_TEST, ExecTest)
+        HANDLERS(L_PUSH, ExecPush)
+        HANDLERS(L_POP,  ExecPop)
+        HANDLERS(L_CALL, ExecCall)
+        HANDLERS(L_IRET, ExecIret)
+        HANDLERS(L_MOV,  ExecMov)
+        HANDLERS(L_SHL,  ExecShl)
+        HANDLERS(L_SHR,  ExecShr)
+        
+        VM87_FUSIONS(FUSED_2, FUSED_3)
+        
+    }
+
+#undef FUSED_LABEL
+#undef FUSED_3
+#undef FUSED_2
+#undef FUSED_NEXT
+#undef FUSED_STEP
+#undef LABELS
+#undef LABELS_AM
+#undef HANDLERS
+#undef HANDLERS_AM
+#undef HANDLER
+#undef NEXT
+#undef STEP
+
+}
+
+#undef VM87_FUSIONS
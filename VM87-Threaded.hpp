@@ -0,0 +1,103 @@
+
+#ifndef VM87_THREADED_HPP
+#define VM87_THREADED_HPP
+
+#include "VM87-Runtime.hpp"
+#include "VM87-JIT.hpp"
+
+#include <vector>
+#include <string>
+
+// Number of block entries before a block gets compiled to native code:
+#ifndef VM87_JIT_THRESHOLD
+#define VM87_JIT_THRESHOLD 64u
+#endif
+
+namespace vm87 {
+    
+    // Alternative execution engine. Program code can never change (writes to
+    // .text are forbidden by Runtime::accessAddress), so the whole .text
+    // section is translated once, right after loading, into a per-PC cache of
+    // predecoded operations. Operations are chained into basic blocks which
+    // are run using direct-threaded dispatch (computed goto); interrupts and
+    // the end-of-program flag are checked when a block is left. A block is
+    // also left once the instruction counter reaches Runtime::nextEvent, so
+    // the virtual timer fires at the same instruction as in the reference
+    // engine.
+    //
+    // Blocks entered often enough are handed to the JitCompiler (if enabled
+    // and supported); native blocks leave the rest to the threaded code.
+    //
+    // Common sequences of two or three operations within a block (compare and
+    // jump, pushes and a call, pops and a return) are fused after the
+    // translation: the first operation gets a superinstruction handler that
+    // runs the whole sequence in one dispatch. Each part still updates PC and
+    // the instruction counter on its own, so a violation in any of them leaves
+    // the same state behind, and the parts after the first keep their own
+    // (unfused) operations for jumps, returns and native blocks landing there.
+    //
+    // Runtime::runProgram remains the reference engine.
+    class ThreadedEngine {
+    
+    public:
+        
+        struct Op {
+            
+            const void * handler;         // Dispatch target (nullptr if invalid)
+            const InstructionDesc * desc;
+            Op * next;                    // Fall-through (nullptr ends the block)
+            USHORT data;
+            USHORT next_pc;
+            
+        };
+        
+        explicit ThreadedEngine(Runtime & rt, bool use_jit = true, bool use_fusion = true);
+        
+        void runProgram();
+        
+        size_t blockCount() const { return block_cnt; }
+        
+        // A line per superinstruction: sites fused and times executed
+        // (sequences that never fused are left out).
+        std::string fusionReport() const;
+        
+        const JitCompiler & jitCompiler() const { return jit; }
+        
+    private:
+        
+        Runtime & rt;
+        
+        std::vector<Op> ops; // Indexed by (pc - text_addr)
+        
+        size_t text_addr;
+        size_t text_len;
+        size_t block_cnt;
+        
+        // Superinstructions (indexed by fusion, see VM87_FUSIONS):
+        std::vector<size_t>             fusion_sites;
+        std::vector<unsigned long long> fusion_hits;
+        
+        // Second tier (indexed like ops):
+        JitCompiler jit;
+        bool jit_enabled;
+        std::vector<JitCompiler::BlockFunc> jit_code;
+        std::vector<unsigned> jit_hits;
+        
+        void translate();
+        
+        void fuse(const void * const * labels);
+        
+        bool runNative(USHORT pc);
+        
+        Op * lookup(USHORT pc);
+        
+        void step();
+        
+        const void * const * dispatch(Op * op);
+        
+    };
+    
+}
+
+#endif /* VM87_THREADED_HPP */
+
@@ -1,7 +1,13 @@
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <ncurses.h>
 #include "CPrint.hpp"
@@ -9,6 +15,16 @@
 #include "Asem-ELFHolder.hpp"
 #include "Asem-SymTab.hpp"
 #include "VM87-Runtime.hpp"
+#include "VM87-Threaded.hpp"
+#include "VM87-Input.hpp"
+#include "VM87-Batch.hpp"
+#include "VM87-Image.hpp"
+#include "VM87-Snapshot.hpp"
+#include "VM87-Bench.hpp"
+#include "VM87-SymIndex.hpp"
+#include "VM87-Profile.hpp"
+#include "VM87-CallGraph.hpp"
+#include "VM87-Counters.hpp"
 
 const asem::Section::Enum SECTIONS[4] = 
     { asem::Section::Text
@@ -25,8 +41,42 @@ void DisplayHelp() {
     std::cout << "   Where optional flags may be (in any order):\n";
     std::cout << "     netbeans - set only if running from netbeans.\n";
     std::cout << "     debug    - run in step-by-step debug mode.\n";
+    std::cout << "     threaded - run using the threaded engine (ignored in debug mode).\n";
+    std::cout << "     nojit    - don't compile hot blocks to native code (threaded engine).\n";
+    std::cout << "     nofuse   - don't fuse instruction sequences into superinstructions (threaded engine).\n";
+    std::cout << "     poll=N   - check host time and input every N instructions (default: adaptive).\n";
+    std::cout << "     headless - no terminal (ncurses) setup, no prompts; exits with r0 (255 on errors).\n";
+    std::cout << "     out=PATH - headless: console output to a file instead of stdout.\n";
+    std::cout << "     in=PATH  - headless: keyboard input from a file instead of stdin.\n";
+    std::cout << "     output=P - console output flush policy: each, line (default) or poll.\n";
+    std::cout << "     vtimer=K - virtual timer, fires every K instructions instead of every second.\n";
+    std::cout << "     profile=PATH - count instructions per address, write a report on exit\n";
+    std::cout << "                    (runs the interpreter - threaded is ignored).\n";
+    std::cout << "     top=N    - profile: number of hottest addresses listed (default: 20).\n";
+    std::cout << "     callgraph=PATH - calls, inclusive and exclusive instructions per function,\n";
+    std::cout << "                      written on exit (runs the interpreter).\n";
+    std::cout << "     folded=PATH    - call stacks in the folded format of flame graph tools.\n";
+    std::cout << "     stats    - print performance counters and MIPS on exit;\n";
+    std::cout << "                with threaded also the superinstructions that were used.\n";
+    std::cout << "     trace=PATH - write a line per instruction executed (runs the interpreter).\n";
     std::cout << "[2]  vm87 info\n";
-    std::cout << "The first option runs programs, the second one displays program info.\n";
+    std::cout << "[3]  vm87 batch \"list_path\" [optional flags...]\n";
+    std::cout << "   Where list_path lists programs (\"path.se [input_path]\" per line)\n";
+    std::cout << "   and optional flags may be threaded, nojit, poll=N, vtimer=K and:\n";
+    std::cout << "     jobs=N      - worker threads (default: one per core).\n";
+    std::cout << "     report=PATH - write the report to a file instead of stdout.\n";
+    std::cout << "[4]  vm87 convert \"path_in\" \"path_out\"\n";
+    std::cout << "   Converts a .se file to a binary image (loaded much faster, run like a .se file).\n";
+    std::cout << "[5]  vm87 snapshot \"path_in\" \"path_out\" [optional flags...]\n";
+    std::cout << "   Saves the loaded program (run like a .se file, continues where it was saved).\n";
+    std::cout << "   Optional flags may be poll=N, vtimer=K and:\n";
+    std::cout << "     steps=N - run N instructions first (headless, from INT_INIT) (default: 0).\n";
+    std::cout << "[6]  vm87 loadbench [megabytes] [reps]\n";
+    std::cout << "   Times the .se loaders on a generated file (default: 8 MB, best of 3).\n";
+    std::cout << "The first option runs programs, the second one displays program info,\n";
+    std::cout << "the third one runs many programs in parallel (headless), the fourth and\n";
+    std::cout << "the fifth one prepare program images and snapshots, the sixth one\n";
+    std::cout << "benchmarks program loading.\n";
     std::cout << "\n";
     
 }
@@ -89,6 +139,212 @@ std::string SectionsToString(const asem::ELFHolder & eh) {
     
 }
 
+int BatchMain(int argc, char** argv) {
+    
+    const char * path_list   = argv[2];
+    const char * path_report = nullptr;
+    
+    vm87::BatchOptions opt{0, false, true, 0, 0};
+    
+    for (int i = 3; i < argc; i += 1) {
+        
+        if (strcmp(argv[i], "threaded") == 0) {
+            opt.threaded = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "nojit") == 0) {
+            opt.jit = false;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "jobs=", 5) == 0) {
+            opt.jobs = unsigned(strtoul(argv[i] + 5, nullptr, 10));
+            continue;
+        }
+        
+        if (strncmp(argv[i], "poll=", 5) == 0) {
+            opt.poll_every = strtoul(argv[i] + 5, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "vtimer=", 7) == 0) {
+            opt.timer_every = strtoul(argv[i] + 7, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "report=", 7) == 0) {
+            path_report = argv[i] + 7;
+            continue;
+        }
+        
+        std::cerr << "Unknown flag [" << argv[i] << "]\n.";
+        
+        return 1;
+        
+    }
+    
+    std::vector<vm87::BatchJob>    jobs;
+    std::vector<vm87::BatchResult> results;
+    
+    try {
+        
+        vm87::LoadBatchList(path_list, jobs);
+        
+    } catch (vm87::LoadError & ex) {
+        
+        std::cerr << "Loading error: " << ex.what() << "\n";
+        
+        return 1;
+        
+    }
+    
+    vm87::RunBatch(jobs, opt, results);
+    
+    if (path_report != nullptr) {
+        
+        std::ofstream file{path_report, std::ios::binary};
+        
+        if (!file.is_open()) {
+            std::cerr << "Can't open report file [" << path_report << "].\n";
+            return 1;
+        }
+        
+        vm87::WriteBatchReport(file, jobs, results);
+        
+    } else {
+        
+        vm87::WriteBatchReport(std::cout, jobs, results);
+        
+    }
+    
+    // Success only if all programs ran without errors:
+    for (const vm87::BatchResult & res : results)
+        if (!res.error.empty()) return 1;
+    
+    return 0;
+    
+}
+
+int ConvertMain(int argc, char** argv) {
+    
+    if (argc != 4) {
+        
+        std::cerr << "Error: expected arguments: convert \"path_in\" \"path_out\".\n";
+        
+        return 1;
+        
+    }
+    
+    asem::ELFHolder eh{};
+    
+    vm87::Runtime rt{};
+    
+    try {
+        
+        // Loading does all the checks (and the layout) the image relies on:
+        eh.loadFromFile(argv[2]);
+        
+        rt.loadFromELF(eh, /* cs */ true);
+        
+        vm87::WriteImage(eh, rt, argv[3]);
+        
+    } catch (vm87::LoadError & ex) {
+        
+        std::cerr << "Loading error: " << ex.what() << "\n";
+        
+        return 1;
+        
+    } catch (std::exception & ex) {
+        
+        std::cerr << "Error: " << ex.what() << "\n";
+        
+        return 1;
+        
+    }
+    
+    return 0;
+    
+}
+
+int SnapshotMain(int argc, char** argv) {
+    
+    unsigned long long opt_steps = 0;
+    
+    vm87::Runtime rt{};
+    
+    rt.use_getch = false;
+    
+    for (int i = 4; i < argc; i += 1) {
+        
+        if (strncmp(argv[i], "steps=", 6) == 0) {
+            opt_steps = strtoull(argv[i] + 6, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "poll=", 5) == 0) {
+            rt.poll_every = strtoul(argv[i] + 5, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "vtimer=", 7) == 0) {
+            rt.timer_every = strtoul(argv[i] + 7, nullptr, 10);
+            continue;
+        }
+        
+        std::cerr << "Unknown flag [" << argv[i] << "]\n.";
+        
+        return 1;
+        
+    }
+    
+    cprint_headless(true);
+    
+    rt.console.setFile(stdout);
+    
+    try {
+        
+        vm87::LoadProgram(rt, argv[2]);
+        
+        if (opt_steps != 0) {
+            
+            rt.stop_at = rt.state.icount + opt_steps;
+            
+            rt.runProgram(/* do_debug */ false);
+            
+            rt.console.flush();
+            
+            if (rt.state.icount < rt.stop_at)
+                throw vm87::UnrecError("Program finished before the snapshot point.");
+            
+            rt.stop_at = 0;
+            
+        }
+        
+        vm87::SaveSnapshot(rt, argv[3]);
+        
+    } catch (vm87::LoadError & ex) {
+        
+        rt.console.flush();
+        
+        std::cerr << "Loading error: " << ex.what() << "\n";
+        
+        return 1;
+        
+    } catch (std::exception & ex) {
+        
+        rt.console.flush();
+        
+        std::cerr << "Error: " << ex.what() << "\n";
+        
+        return 1;
+        
+    }
+    
+    return 0;
+    
+}
+
 #define EXIT(val) do { rv = val; goto END_PROGRAM; } while (0)
 
 int main(int argc, char** argv) {
@@ -99,8 +355,25 @@ int main(int argc, char** argv) {
     
     bool flag_netbeans = false;
     bool flag_debug    = false;
+    bool flag_threaded = false;
+    bool flag_nojit    = false;
+    bool flag_nofuse   = false;
+    bool flag_headless = false;
+    bool flag_stats    = false;
+    
+    const char * path_out = nullptr; // (headless)
+    const char * path_kbd = nullptr; // (headless)
+    const char * path_prof = nullptr;
+    const char * path_cg   = nullptr;
+    const char * path_fold = nullptr;
+    const char * path_trace = nullptr;
+    
+    size_t opt_top = 20;
     
-    std::cout << argc << "\n";
+    unsigned long opt_poll   = 0;
+    unsigned long opt_vtimer = 0;
+    
+    vm87::ConsoleOutput::Policy opt_output = vm87::ConsoleOutput::FLUSH_LINE;
     
     // Main arguments:
     if (argc < 2) {
@@ -116,6 +389,38 @@ int main(int argc, char** argv) {
         return 0;
     }
     
+    if (strcmp(argv[1], "batch") == 0) {
+        if (argc >= 3) return BatchMain(argc, argv);
+        std::cout << "Too few arguments.\n";
+        DisplayHelp();
+        return 1;
+    }
+    
+    if (strcmp(argv[1], "convert") == 0) {
+        if (argc == 4) return ConvertMain(argc, argv);
+        std::cout << "Expected arguments: convert \"path_in\" \"path_out\".\n";
+        DisplayHelp();
+        return 1;
+    }
+    
+    if (strcmp(argv[1], "loadbench") == 0) {
+        size_t   mb   = (argc >= 3) ? strtoul(argv[2], nullptr, 10) : 8u;
+        unsigned reps = (argc >= 4) ? unsigned(strtoul(argv[3], nullptr, 10)) : 3u;
+        try {
+            return vm87::RunLoaderBenchmark(std::cout, mb * 1000000u, reps ? reps : 1u) ? 0 : 1;
+        } catch (std::exception & ex) {
+            std::cerr << "Error: " << ex.what() << "\n";
+            return 1;
+        }
+    }
+    
+    if (strcmp(argv[1], "snapshot") == 0) {
+        if (argc >= 4) return SnapshotMain(argc, argv);
+        std::cout << "Expected arguments: snapshot \"path_in\" \"path_out\" [flags...].\n";
+        DisplayHelp();
+        return 1;
+    }
+    
     path_in = argv[1];
     
     // Optional flags:
@@ -131,6 +436,82 @@ int main(int argc, char** argv) {
             continue;
         }
         
+        if (strcmp(argv[i], "threaded") == 0) {
+            flag_threaded = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "nojit") == 0) {
+            flag_nojit = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "nofuse") == 0) {
+            flag_nofuse = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "stats") == 0) {
+            flag_stats = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "headless") == 0) {
+            flag_headless = true;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "out=", 4) == 0) {
+            path_out = argv[i] + 4;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "in=", 3) == 0) {
+            path_kbd = argv[i] + 3;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "poll=", 5) == 0) {
+            opt_poll = strtoul(argv[i] + 5, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "vtimer=", 7) == 0) {
+            opt_vtimer = strtoul(argv[i] + 7, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "profile=", 8) == 0) {
+            path_prof = argv[i] + 8;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "callgraph=", 10) == 0) {
+            path_cg = argv[i] + 10;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "folded=", 7) == 0) {
+            path_fold = argv[i] + 7;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "trace=", 6) == 0) {
+            path_trace = argv[i] + 6;
+            continue;
+        }
+        
+        if (strncmp(argv[i], "top=", 4) == 0) {
+            opt_top = strtoul(argv[i] + 4, nullptr, 10);
+            continue;
+        }
+        
+        if (strncmp(argv[i], "output=", 7) == 0) {
+            if (vm87::ConsoleOutput::ParsePolicy(argv[i] + 7, opt_output)) continue;
+            std::cout << "Unknown output policy [" << (argv[i] + 7) << "]\n.";
+            return 1;
+        }
+        
         if (strcmp(argv[i], "info") == 0) {
             std::cout << "Flag [info] is ignored unless it's the first and only argument.";
             continue;
@@ -142,57 +523,158 @@ int main(int argc, char** argv) {
         
     }
     
-    std::cout << "Running...\n";
+    if (flag_headless && flag_debug) {
+        std::cout << "Flag [debug] can't be used in headless mode.\n";
+        return 1;
+    }
+    
+    if (!flag_headless && (path_out != nullptr || path_kbd != nullptr)) {
+        std::cout << "Flags [out] and [in] require headless mode.\n";
+        return 1;
+    }
+    
+    // Headless streams:
+    std::FILE * file_out = stdout;
+    int         fd_kbd   = 0;
+    
+    if (path_out != nullptr && (file_out = std::fopen(path_out, "wb")) == nullptr) {
+        std::cerr << "Can't open output file [" << path_out << "].\n";
+        return 1;
+    }
+    
+    if (path_kbd != nullptr && (fd_kbd = open(path_kbd, O_RDONLY)) < 0) {
+        std::cerr << "Can't open input file [" << path_kbd << "].\n";
+        if (file_out != stdout) std::fclose(file_out);
+        return 1;
+    }
+    
+    std::FILE * file_trace = nullptr;
     
-    // Initialize NCURSES:
-    initscr();
-    cbreak();
-    noecho();
-    if (flag_netbeans) getch();
-    scrollok(stdscr, TRUE);
-    nodelay(stdscr, TRUE);
+    if (path_trace != nullptr && (file_trace = std::fopen(path_trace, "w")) == nullptr) {
+        std::cerr << "Can't open trace file [" << path_trace << "].\n";
+        if (file_out != stdout) std::fclose(file_out);
+        if (fd_kbd != 0) close(fd_kbd);
+        return 1;
+    }
+    
+    if (flag_headless) {
+        
+        cprint_headless(true);
+        
+    } else {
+        
+        std::cout << argc << "\n";
+        std::cout << "Running...\n";
+        
+        // Initialize NCURSES:
+        initscr();
+        cbreak();
+        noecho();
+        if (flag_netbeans) getch();
+        scrollok(stdscr, TRUE);
+        nodelay(stdscr, TRUE);
+        
+    }
     
     // Initialize other:
     int rv = 0;
     
-    asem::ELFHolder eh{};
-    
     vm87::Runtime rt{};
     
+    rt.poll_every  = opt_poll;
+    rt.timer_every = opt_vtimer;
+    
+    rt.console.setPolicy(opt_output);
+    
+    if (flag_headless) rt.console.setFile(file_out);
+    
+    // Keyboard input on its own thread (debug mode steps with getch()):
+    vm87::InputThread input{};
+    
+    vm87::SymbolIndex symbols{}; // (For crash reports and the profile)
+    
+    vm87::Profile profile{};
+    
+    if (path_prof != nullptr) rt.profile = &profile;
+    
+    vm87::CallGraph callgraph{symbols};
+    
+    if (path_cg != nullptr || path_fold != nullptr) rt.callgraph = &callgraph;
+    
+    rt.trace = file_trace;
+    
+    vm87::TIME_POINT run_start = vm87::CLOCK::now(); // (stats)
+    
+    std::string fusion_report; // (stats, threaded)
+    
+    if (!flag_debug) {
+        input.start(fd_kbd);
+        rt.input = &input;
+    }
+    
     try {
         
-        eh.loadFromFile(path_in);
-        
-        rt.loadFromELF(eh, /* cs */ true); // CS must be true!!!
-        
-        rt.runProgram(/* do_debug */ flag_debug);
+        vm87::LoadProgram(rt, path_in, &symbols); // .se, image or snapshot
+        
+        run_start = vm87::CLOCK::now();
+        
+        if (flag_threaded && !flag_debug && rt.profile == nullptr && rt.callgraph == nullptr &&
+            rt.trace == nullptr) {
+            
+            vm87::ThreadedEngine te{rt, /* use_jit */ !flag_nojit, /* use_fusion */ !flag_nofuse};
+            
+            te.runProgram();
+            
+            fusion_report = te.fusionReport();
+            
+        } else {
+            
+            rt.runProgram(/* do_debug */ flag_debug);
+            
+        }
         
     } catch (vm87::LoadError & ex) {
         
+        rt.console.flush();
+        
         cprint("Loading error: %s\n\n", ex.what());
         
         EXIT(1);
         
     } catch (vm87::UnrecError & ex) {
         
-        cprint("Unrecoverable error: %s\n\n", ex.what());
+        rt.console.flush();
+        
+        cprint("Unrecoverable error: %s\n", ex.what());
+        
+        cprint("PC = 0x%04X (%s)\n\n", unsigned(rt.state.regs[vm87::Runtime::PC])
+              , symbols.describe(rt.state.regs[vm87::Runtime::PC]).c_str());
         
         EXIT(1);
         
     } catch (vm87::ViolationError & ex) {
         
-        cprint("Unhandled violation error: %s\n\n", ex.what());
+        rt.console.flush();
+        
+        cprint("Unhandled violation error: %s\n", ex.what());
+        
+        cprint("PC = 0x%04X (%s)\n\n", unsigned(rt.state.regs[vm87::Runtime::PC])
+              , symbols.describe(rt.state.regs[vm87::Runtime::PC]).c_str());
         
         EXIT(1);
         
     } catch (std::exception & ex) {
         
+        rt.console.flush();
+        
         cprint("Unnamed exception caught: %s\n\n", ex.what());
         
         EXIT(1);
         
     } catch (...) {
        
+        rt.console.flush();
+       
         cprint("Unknown exception caught: %s\n\n", "(no message available).");
         
         EXIT(1);
@@ -201,6 +683,71 @@ int main(int argc, char** argv) {
     
     END_PROGRAM:
     
+    double run_secs = std::chrono::duration<double>(vm87::CLOCK::now() - run_start).count();
+    
+    input.stop();
+    
+    rt.console.flush();
+    
+    if (flag_stats) {
+        
+        std::string report = vm87::PerfCountersToString(rt, run_secs) + fusion_report;
+        
+        // (Line by line - cprint has a limited buffer)
+        for (size_t pos = 0, end; pos < report.size(); pos = end + 1) {
+            end = report.find('\n', pos);
+            cprint("%s\n", report.substr(pos, end - pos).c_str());
+        }
+        
+    }
+    
+    if (path_prof != nullptr) {
+        
+        std::ofstream file{path_prof};
+        
+        if (file.is_open())
+            vm87::WriteProfileReport(file, profile, symbols, opt_top);
+        else
+            cprint("Can't open profile file [%s].\n", path_prof);
+        
+    }
+    
+    if (rt.callgraph != nullptr) {
+        
+        callgraph.finish(rt.state.icount);
+        
+        std::ofstream file_cg, file_fold;
+        
+        if (path_cg != nullptr) {
+            file_cg.open(path_cg);
+            if (file_cg.is_open())
+                callgraph.writeReport(file_cg);
+            else
+                cprint("Can't open call graph file [%s].\n", path_cg);
+        }
+        
+        if (path_fold != nullptr) {
+            file_fold.open(path_fold);
+            if (file_fold.is_open())
+                callgraph.writeFolded(file_fold);
+            else
+                cprint("Can't open folded stacks file [%s].\n", path_fold);
+        }
+        
+    }
+    
+    if (file_trace != nullptr) std::fclose(file_trace);
+    
+    if (flag_headless) {
+        
+        if (file_out != stdout) std::fclose(file_out);
+        if (fd_kbd != 0) close(fd_kbd);
+        
+        // Exit with the guest's status:
+        return (rv == 0) ? int(rt.state.regs[0] & 0xFFu) : 255;
+        
+    }
+    
     if (rv == 0)
         cprint("\nProgram finished. Press ENTER to continue...\n");
     else
@@ -38,9 +38,25 @@ OBJECTFILES= \
 	${OBJECTDIR}/Asem-ELFHolder.o \
 	${OBJECTDIR}/Asem-Func.o \
 	${OBJECTDIR}/Asem-FuncEH.o \
+	${OBJECTDIR}/Asem-SymStore.o \
 	${OBJECTDIR}/Asem-SymTab.o \
 	${OBJECTDIR}/CPrint.o \
+	${OBJECTDIR}/HexCodec.o \
+	${OBJECTDIR}/VM87-Batch.o \
+	${OBJECTDIR}/VM87-Bench.o \
+	${OBJECTDIR}/VM87-CallGraph.o \
+	${OBJECTDIR}/VM87-Console.o \
+	${OBJECTDIR}/VM87-Counters.o \
+	${OBJECTDIR}/VM87-Decode.o \
+	${OBJECTDIR}/VM87-Image.o \
+	${OBJECTDIR}/VM87-Input.o \
+	${OBJECTDIR}/VM87-JIT.o \
+	${OBJECTDIR}/VM87-Mmio.o \
+	${OBJECTDIR}/VM87-Profile.o \
 	${OBJECTDIR}/VM87-Runtime.o \
+	${OBJECTDIR}/VM87-Snapshot.o \
+	${OBJECTDIR}/VM87-SymIndex.o \
+	${OBJECTDIR}/VM87-Threaded.o \
 	${OBJECTDIR}/ZMain.o
 
 
@@ -58,7 +74,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=
+LDLIBSOPTIONS=-lncurses -pthread
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -83,6 +99,11 @@ ${OBJECTDIR}/Asem-FuncEH.o: Asem-FuncEH.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Asem-FuncEH.o Asem-FuncEH.cpp
 
+${OBJECTDIR}/Asem-SymStore.o: Asem-SymStore.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Asem-SymStore.o Asem-SymStore.cpp
+
 ${OBJECTDIR}/Asem-SymTab.o: Asem-SymTab.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -93,11 +114,86 @@ ${OBJECTDIR}/CPrint.o: CPrint.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/CPrint.o CPrint.cpp
 
+${OBJECTDIR}/HexCodec.o: HexCodec.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/HexCodec.o HexCodec.cpp
+
+${OBJECTDIR}/VM87-Batch.o: VM87-Batch.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Batch.o VM87-Batch.cpp
+
+${OBJECTDIR}/VM87-Bench.o: VM87-Bench.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Bench.o VM87-Bench.cpp
+
+${OBJECTDIR}/VM87-CallGraph.o: VM87-CallGraph.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-CallGraph.o VM87-CallGraph.cpp
+
+${OBJECTDIR}/VM87-Console.o: VM87-Console.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Console.o VM87-Console.cpp
+
+${OBJECTDIR}/VM87-Counters.o: VM87-Counters.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Counters.o VM87-Counters.cpp
+
+${OBJECTDIR}/VM87-Decode.o: VM87-Decode.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Decode.o VM87-Decode.cpp
+
+${OBJECTDIR}/VM87-Image.o: VM87-Image.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Image.o VM87-Image.cpp
+
+${OBJECTDIR}/VM87-Input.o: VM87-Input.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Input.o VM87-Input.cpp
+
+${OBJECTDIR}/VM87-JIT.o: VM87-JIT.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-JIT.o VM87-JIT.cpp
+
+${OBJECTDIR}/VM87-Mmio.o: VM87-Mmio.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Mmio.o VM87-Mmio.cpp
+
+${OBJECTDIR}/VM87-Profile.o: VM87-Profile.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Profile.o VM87-Profile.cpp
+
 ${OBJECTDIR}/VM87-Runtime.o: VM87-Runtime.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Runtime.o VM87-Runtime.cpp
 
+${OBJECTDIR}/VM87-Snapshot.o: VM87-Snapshot.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Snapshot.o VM87-Snapshot.cpp
+
+${OBJECTDIR}/VM87-SymIndex.o: VM87-SymIndex.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-SymIndex.o VM87-SymIndex.cpp
+
+${OBJECTDIR}/VM87-Threaded.o: VM87-Threaded.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/VM87-Threaded.o VM87-Threaded.cpp
+
 ${OBJECTDIR}/ZMain.o: ZMain.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"